@@ -0,0 +1,142 @@
+/*
+ * NDBarAllocCount.cpp
+ *
+ * Heap allocation counting for the FrameAllocations PV of NDPluginBar.
+ *
+ * On glibc, malloc, calloc, realloc, the aligned variants and free are defined
+ * here and forward to the glibc implementations, counting each allocation in a
+ * thread local counter. C++ operator new calls malloc, so it is counted too.
+ * All of them are replaced together, so memory is always returned to the
+ * allocator it came from. Elsewhere the global operator new and delete are
+ * replaced instead, which only counts C++ allocations.
+ *
+ * This is a debugging aid, only compiled in with BAR_COUNT_ALLOCATIONS = YES.
+ * The definitions clash with libc.a in a fully static link, are bypassed by a
+ * preloaded allocator such as jemalloc, and the initial exec TLS counter needs
+ * the plugin library to be loaded at startup rather than with dlopen.
+ *
+ * Created on: October 18, 2026
+ */
+
+#include "NDBarAllocCount.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <new>
+
+#if defined(__GLIBC__)
+#define BAR_COUNT_MALLOC
+#endif
+
+// initial exec TLS, so that reading the counter can never itself call malloc
+#if defined(__GNUC__)
+static __thread unsigned long threadAllocations __attribute__((tls_model("initial-exec")));
+#else
+static thread_local unsigned long threadAllocations;
+#endif
+
+unsigned long barThreadAllocations() {
+    return threadAllocations;
+}
+
+#ifdef BAR_COUNT_MALLOC
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    threadAllocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    threadAllocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    threadAllocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    threadAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    threadAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    // alignment must be a power of two multiple of sizeof(void *)
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    threadAllocations++;
+    void *allocated = __libc_memalign(alignment, size);
+    if (allocated == NULL) return ENOMEM;
+    *ptr = allocated;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    threadAllocations++;
+    return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size) {
+    threadAllocations++;
+    return __libc_pvalloc(size);
+}
+}
+
+#else
+
+void *operator new(size_t size) {
+    threadAllocations++;
+    void *ptr = malloc(size > 0 ? size : 1);
+    if (ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    threadAllocations++;
+    return malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+#endif
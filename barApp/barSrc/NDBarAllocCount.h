@@ -0,0 +1,20 @@
+/*
+ * NDBarAllocCount.h
+ *
+ * Per thread count of heap allocations, used by NDPluginBar to report the
+ * allocations made while processing each frame. On glibc the malloc family
+ * is wrapped, so allocations made inside OpenCV, zbar and areaDetector are
+ * counted as well as our own. Elsewhere only C++ operator new is counted.
+ * Only built with BAR_COUNT_ALLOCATIONS = YES in CONFIG_SITE, as it replaces
+ * the allocator of the whole process.
+ *
+ * Created on: October 18, 2026
+ */
+
+#ifndef NDBarAllocCount_H
+#define NDBarAllocCount_H
+
+// number of heap allocations made by the calling thread since it started
+unsigned long barThreadAllocations();
+
+#endif
@@ -0,0 +1,609 @@
+/*
+ * NDBarBatch.cpp
+ *
+ * Offline batch decoding of recorded image sets, for example to recover reads that
+ * were missed live. Images are fed through the same NDBarDecoder pipeline used by
+ * NDPluginBar, across a pool of worker threads. On POSIX systems each file is
+ * memory-mapped and decoded in place, elsewhere it is streamed into a per-thread buffer.
+ *
+ * Any format readable by OpenCV's imdecode (TIFF, PNG, JPEG, BMP, PGM) is supported.
+ * When built with HDF5, every frame of the NDArray dataset of .h5 files written by
+ * NDFileHDF5 is decoded as well. The frames of each file are split into contiguous
+ * ranges, and a worker keeps the file open while it decodes a range.
+ *
+ * Created on: October 18, 2026
+ */
+
+#include "NDBarBatch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "NDBarDecoder.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BAR_BATCH_POSIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef BAR_HDF5
+#include <hdf5.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+static const char *batchName = "NDBarBatchDecode";
+
+// Number of codes kept per frame in the results file
+#define MAX_BATCH_CODES 64
+
+// Dataset NDFileHDF5 stores the NDArrays in by default
+#define BAR_HDF5_DATASET "/entry/data/data"
+
+/* A frame to decode: a whole image file, or one frame of an HDF5 dataset */
+typedef struct {
+    string path;
+    // index of the frame in the HDF5 dataset, -1 for image files
+    int frame;
+} bar_batch_input;
+
+/* Inputs decoded in one go by a worker, from begin up to but not including end */
+typedef struct {
+    size_t begin;
+    size_t end;
+} bar_batch_range;
+
+/* Results of decoding a single frame */
+typedef struct {
+    bool readable;
+    vector<bar_QR_code> codes;
+} bar_batch_frame;
+
+//------------------------------------------------------
+// File types
+//------------------------------------------------------
+
+/**
+ * Function that checks if a file name ends with one of the given extensions, ignoring case
+ */
+static bool hasExtension(const string &fileName, const char *const *extensions, size_t count) {
+    size_t dot = fileName.find_last_of('.');
+    if (dot == string::npos) return false;
+    string ext = fileName.substr(dot);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for (size_t i = 0; i < count; i++) {
+        if (ext == extensions[i]) return true;
+    }
+    return false;
+}
+
+/**
+ * Function that checks if a file name has an image extension we can decode
+ */
+static bool hasImageExtension(const string &fileName) {
+    static const char *extensions[] = {".tif", ".tiff", ".png", ".jpg", ".jpeg", ".bmp", ".pgm"};
+    return hasExtension(fileName, extensions, sizeof(extensions) / sizeof(extensions[0]));
+}
+
+/**
+ * Function that checks if a file name has an HDF5 extension
+ */
+static bool hasHDF5Extension(const string &fileName) {
+    static const char *extensions[] = {".h5", ".hdf5", ".hdf"};
+    return hasExtension(fileName, extensions, sizeof(extensions) / sizeof(extensions[0]));
+}
+
+//------------------------------------------------------
+// HDF5 input
+//------------------------------------------------------
+
+#ifdef BAR_HDF5
+// the HDF5 library is normally built without thread safety, so all calls are serialized
+static mutex hdf5Lock;
+
+/* Shape of an NDFileHDF5 dataset. Mono frames are stored as [frame, y, x] and RGB1 frames as
+ * [frame, y, x, 3], a dataset holding a single frame may leave out the frame dimension */
+typedef struct {
+    int rank;
+    hsize_t frames;
+    hsize_t rows;
+    hsize_t cols;
+    hsize_t channels;
+} bar_hdf5_shape;
+
+/**
+ * Function that opens the NDArray dataset of an HDF5 file and reads its shape. Must be called
+ * with hdf5Lock held.
+ *
+ * @params[in]: path   -> HDF5 file
+ * @params[out]: file  -> open file, to be closed by the caller on success
+ * @params[out]: shape -> shape of the dataset
+ * @return: open dataset, or a negative value if the file has no supported NDArray dataset
+ */
+static hid_t openHDF5Dataset(const string &path, hid_t *file, bar_hdf5_shape *shape) {
+    *file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (*file < 0) return -1;
+    hid_t dataset = H5Dopen2(*file, BAR_HDF5_DATASET, H5P_DEFAULT);
+    if (dataset < 0) {
+        H5Fclose(*file);
+        return -1;
+    }
+    hid_t space = H5Dget_space(dataset);
+    hsize_t dims[4] = {0, 0, 0, 0};
+    shape->rank = H5Sget_simple_extent_ndims(space);
+    if (shape->rank >= 2 && shape->rank <= 4) H5Sget_simple_extent_dims(space, dims, NULL);
+    H5Sclose(space);
+
+    if (shape->rank == 2) {
+        shape->frames = 1;
+        shape->rows = dims[0];
+        shape->cols = dims[1];
+        shape->channels = 1;
+    } else if (shape->rank == 3 || (shape->rank == 4 && dims[3] == 3)) {
+        shape->frames = dims[0];
+        shape->rows = dims[1];
+        shape->cols = dims[2];
+        shape->channels = shape->rank == 4 ? 3 : 1;
+    } else {
+        H5Dclose(dataset);
+        H5Fclose(*file);
+        return -1;
+    }
+    return dataset;
+}
+
+/**
+ * Function that adds every frame of the NDArray dataset of an HDF5 file to the inputs
+ *
+ * @return: 0 if the file holds a supported dataset, -1 otherwise
+ */
+static int collectHDF5Frames(const string &path, vector<bar_batch_input> &inputs) {
+    lock_guard<mutex> guard(hdf5Lock);
+    hid_t file;
+    bar_hdf5_shape shape;
+    hid_t dataset = openHDF5Dataset(path, &file, &shape);
+    if (dataset < 0) {
+        fprintf(stderr, "%s: Error, no image dataset %s in %s\n", batchName, BAR_HDF5_DATASET,
+                path.c_str());
+        return -1;
+    }
+    for (hsize_t i = 0; i < shape.frames; i++) {
+        bar_batch_input input = {path, (int) i};
+        inputs.push_back(input);
+    }
+    H5Dclose(dataset);
+    H5Fclose(file);
+    return 0;
+}
+
+/* NDArray dataset of an HDF5 file, kept open by a worker for a range of its frames */
+typedef struct {
+    hid_t file;
+    hid_t dataset;
+    bar_hdf5_shape shape;
+    bool eightBit;
+} bar_hdf5_reader;
+
+/**
+ * Function that opens the NDArray dataset of an HDF5 file for reading frames
+ *
+ * @params[in]: path    -> HDF5 file
+ * @params[out]: reader -> open dataset, its dataset is negative on failure
+ * @return: 0 on success, -1 if the file has no supported NDArray dataset
+ */
+static int openHDF5Reader(const string &path, bar_hdf5_reader *reader) {
+    lock_guard<mutex> guard(hdf5Lock);
+    reader->dataset = openHDF5Dataset(path, &reader->file, &reader->shape);
+    if (reader->dataset < 0) return -1;
+    hid_t type = H5Dget_type(reader->dataset);
+    reader->eightBit = H5Tget_class(type) == H5T_INTEGER && H5Tget_size(type) == 1;
+    H5Tclose(type);
+    return 0;
+}
+
+/**
+ * Function that closes a dataset opened with openHDF5Reader, if it was opened
+ */
+static void closeHDF5Reader(bar_hdf5_reader *reader) {
+    if (reader->dataset < 0) return;
+    lock_guard<mutex> guard(hdf5Lock);
+    H5Dclose(reader->dataset);
+    H5Fclose(reader->file);
+    reader->dataset = -1;
+}
+
+/**
+ * Function that reads one frame of an open NDArray dataset, as an 8 bit grayscale image.
+ * 8 bit data is read as is, wider data is scaled to the range of the frame.
+ *
+ * @params[in]: reader -> dataset opened with openHDF5Reader
+ * @params[in]: frame  -> index of the frame in the dataset
+ * @params[out]: img   -> decoded frame, left empty on failure
+ */
+static void readHDF5Frame(const bar_hdf5_reader &reader, int frame, Mat &img) {
+    const bar_hdf5_shape &shape = reader.shape;
+    if ((hsize_t) frame >= shape.frames) return;
+    hsize_t start[4] = {0, 0, 0, 0};
+    hsize_t count[4] = {1, shape.rows, shape.cols, shape.channels};
+    if (shape.rank == 2) {
+        count[0] = shape.rows;
+        count[1] = shape.cols;
+    } else {
+        start[0] = (hsize_t) frame;
+    }
+    int channels = (int) shape.channels;
+    Mat raw((int) shape.rows, (int) shape.cols,
+            reader.eightBit ? CV_8UC(channels) : CV_32FC(channels));
+    {
+        lock_guard<mutex> guard(hdf5Lock);
+        hid_t fileSpace = H5Dget_space(reader.dataset);
+        hid_t memSpace = H5Screate_simple(shape.rank, count, NULL);
+        H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, start, NULL, count, NULL);
+        if (H5Dread(reader.dataset, reader.eightBit ? H5T_NATIVE_UCHAR : H5T_NATIVE_FLOAT,
+                    memSpace, fileSpace, H5P_DEFAULT, raw.data) < 0)
+            raw.release();
+        H5Sclose(memSpace);
+        H5Sclose(fileSpace);
+    }
+    if (raw.empty()) return;
+    if (raw.channels() != 1) cvtColor(raw, raw, COLOR_RGB2GRAY);
+    if (raw.depth() == CV_8U)
+        img = raw;
+    else
+        normalize(raw, img, 0, 255, NORM_MINMAX, CV_8U);
+}
+#endif
+
+//------------------------------------------------------
+// Input collection
+//------------------------------------------------------
+
+/**
+ * Function that adds a file to the inputs, as a single image, or as one input per frame for
+ * HDF5 files
+ *
+ * @return: 0 on success, -1 if an HDF5 file could not be read or HDF5 input is not allowed
+ */
+static int addInputFile(const string &path, vector<bar_batch_input> &inputs, bool readHDF5) {
+    if (hasHDF5Extension(path)) {
+        if (!readHDF5) {
+            fprintf(stderr, "%s: Skipping %s, HDF5 files are only read by barBatchDecode\n",
+                    batchName, path.c_str());
+            return -1;
+        }
+#ifdef BAR_HDF5
+        return collectHDF5Frames(path, inputs);
+#else
+        fprintf(stderr, "%s: Error, built without HDF5 support, cannot read %s\n", batchName,
+                path.c_str());
+        return -1;
+#endif
+    }
+    bar_batch_input input = {path, -1};
+    inputs.push_back(input);
+    return 0;
+}
+
+/**
+ * Function that builds the list of frames to decode. If input is a directory, all images and
+ * HDF5 files in it are used, sorted by name. Otherwise input is read as a list file with one
+ * path per line. Empty lines and lines starting with '#' are skipped. HDF5 files that cannot
+ * be read are reported and skipped.
+ *
+ * @params[in]: input    -> directory or list file
+ * @params[out]: inputs  -> frames to decode
+ * @params[in]: readHDF5 -> false to skip HDF5 files
+ * @return: 0 if the input could be read, -1 otherwise
+ */
+static int collectInputs(const char *input, vector<bar_batch_input> &inputs, bool readHDF5) {
+    vector<string> files;
+    bool directory = false;
+#ifdef BAR_BATCH_POSIX
+    struct stat st;
+    if (stat(input, &st) != 0) {
+        fprintf(stderr, "%s: Error, cannot access %s\n", batchName, input);
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        directory = true;
+        DIR *dir = opendir(input);
+        if (dir == NULL) {
+            fprintf(stderr, "%s: Error, cannot open directory %s\n", batchName, input);
+            return -1;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (hasImageExtension(entry->d_name) || hasHDF5Extension(entry->d_name)) {
+                files.push_back(string(input) + "/" + entry->d_name);
+            }
+        }
+        closedir(dir);
+        sort(files.begin(), files.end());
+    }
+#endif
+    if (!directory) {
+        // directories are only listed on POSIX systems, elsewhere input must be a list file
+        ifstream listFile(input);
+        if (!listFile) {
+            fprintf(stderr, "%s: Error, cannot open list file %s\n", batchName, input);
+            return -1;
+        }
+        string line;
+        while (getline(listFile, line)) {
+            if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+            if (line.empty() || line[0] == '#') continue;
+            files.push_back(line);
+        }
+    }
+    for (size_t i = 0; i < files.size(); i++) addInputFile(files[i], inputs, readHDF5);
+    return 0;
+}
+
+/**
+ * Function that splits the inputs into the ranges handed out to the workers. Each image file
+ * is a range of its own. The frames of an HDF5 file are split into at most numThreads ranges
+ * of consecutive frames, so each file is opened once per range rather than once per frame.
+ *
+ * @params[in]: inputs     -> frames to decode, the frames of a file next to each other
+ * @params[in]: numThreads -> number of workers
+ * @params[out]: ranges    -> ranges covering all inputs, in order
+ */
+static void splitInputs(const vector<bar_batch_input> &inputs, int numThreads,
+                        vector<bar_batch_range> &ranges) {
+    size_t i = 0;
+    while (i < inputs.size()) {
+        size_t end = i + 1;
+        if (inputs[i].frame >= 0) {
+            while (end < inputs.size() && inputs[end].frame >= 0 &&
+                   inputs[end].path == inputs[i].path)
+                end++;
+        }
+        size_t length = (end - i + numThreads - 1) / numThreads;
+        while (i < end) {
+            bar_batch_range range = {i, min(i + length, end)};
+            ranges.push_back(range);
+            i = range.end;
+        }
+    }
+}
+
+//------------------------------------------------------
+// Decoding
+//------------------------------------------------------
+
+/**
+ * Function that reads a single image file as grayscale. The file is memory-mapped where
+ * possible so that the encoded bytes are decoded without a copy.
+ *
+ * @params[in]: path   -> image file to read
+ * @params[in]: buffer -> per thread buffer used when the file cannot be memory-mapped
+ * @params[out]: img   -> decoded image, left empty on failure
+ */
+static void readImageFile(const string &path, vector<char> &buffer, Mat &img) {
+#ifdef BAR_BATCH_POSIX
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            img = imdecode(Mat(1, (int) st.st_size, CV_8UC1, mapped), IMREAD_GRAYSCALE);
+            munmap(mapped, st.st_size);
+        }
+    }
+    close(fd);
+#else
+    ifstream file(path.c_str(), ios::binary | ios::ate);
+    if (!file) return;
+    streamsize size = file.tellg();
+    if (size <= 0) return;
+    buffer.resize((size_t) size);
+    file.seekg(0, ios::beg);
+    if (!file.read(&buffer[0], size)) return;
+    img = imdecode(Mat(1, (int) size, CV_8UC1, &buffer[0]), IMREAD_GRAYSCALE);
+#endif
+}
+
+/**
+ * Function that decodes a single frame.
+ *
+ * @params[in]: img       -> frame read from its file, empty if it could not be read
+ * @params[in]: decoder   -> decoder owned by the calling thread
+ * @params[in]: options   -> decoder settings shared by all frames
+ * @params[in]: codes     -> per thread storage for MAX_BATCH_CODES codes
+ * @params[out]: frame    -> decoded codes for the frame
+ */
+static void decodeFrame(const Mat &img, NDBarDecoder &decoder, const bar_decode_options &options,
+                        bar_QR_code *codes, bar_batch_frame &frame) {
+    frame.readable = false;
+    if (img.empty()) return;
+    try {
+        bool partial;
+        int numCodes = decoder.decode_bar_codes(img, options, codes, MAX_BATCH_CODES, &partial);
+        if (numCodes > MAX_BATCH_CODES) numCodes = MAX_BATCH_CODES;
+        frame.readable = numCodes >= 0;
+        if (frame.readable) frame.codes.assign(codes, codes + numCodes);
+    } catch (cv::Exception &e) {
+        frame.readable = false;
+    }
+}
+
+/**
+ * Worker thread body. Each worker owns a decoder and pulls the next range of inputs from a
+ * shared counter until all ranges have been decoded. The HDF5 file of a range is opened once,
+ * and only reading a frame holds hdf5Lock, so other workers decode meanwhile.
+ */
+static void batchWorker(const vector<bar_batch_input> *inputs,
+                        const vector<bar_batch_range> *ranges, vector<bar_batch_frame> *frames,
+                        atomic<size_t> *nextRange, const bar_decode_options *options) {
+    NDBarDecoder decoder;
+    vector<char> buffer;
+    vector<bar_QR_code> codes(MAX_BATCH_CODES);
+    size_t r;
+    while ((r = nextRange->fetch_add(1)) < ranges->size()) {
+        const bar_batch_range &range = (*ranges)[r];
+#ifdef BAR_HDF5
+        bar_hdf5_reader reader;
+        reader.dataset = -1;
+        if ((*inputs)[range.begin].frame >= 0) openHDF5Reader((*inputs)[range.begin].path, &reader);
+#endif
+        for (size_t i = range.begin; i < range.end; i++) {
+            const bar_batch_input &input = (*inputs)[i];
+            Mat img;
+            if (input.frame < 0) readImageFile(input.path, buffer, img);
+#ifdef BAR_HDF5
+            else if (reader.dataset >= 0)
+                readHDF5Frame(reader, input.frame, img);
+#endif
+            decodeFrame(img, decoder, *options, &codes[0], (*frames)[i]);
+        }
+#ifdef BAR_HDF5
+        closeHDF5Reader(&reader);
+#endif
+    }
+}
+
+//------------------------------------------------------
+// Results output
+//------------------------------------------------------
+
+/**
+ * Function that writes a CSV field, quoting it if it contains separators or quotes
+ */
+static void writeCSVField(FILE *out, const string &field) {
+    if (field.find_first_of(",\"\r\n") == string::npos) {
+        fputs(field.c_str(), out);
+        return;
+    }
+    fputc('"', out);
+    for (size_t i = 0; i < field.size(); i++) {
+        if (field[i] == '"') fputc('"', out);
+        fputc(field[i], out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * Function that writes the file and frame columns of a row. The frame is empty for image files
+ */
+static void writeFrameFields(FILE *out, const bar_batch_input &input) {
+    writeCSVField(out, input.path);
+    if (input.frame >= 0)
+        fprintf(out, ",%d", input.frame);
+    else
+        fputc(',', out);
+}
+
+/**
+ * Function that writes the results file. There is one row per decoded code, and one row with
+ * an empty code for frames with no codes or that could not be read. Corners are written in the
+ * same order as the corner PVs of the plugin, with y measured from the top of the image.
+ */
+static int writeResults(const char *outputFile, const vector<bar_batch_input> &inputs,
+                        const vector<bar_batch_frame> &frames) {
+    FILE *out = fopen(outputFile, "w");
+    if (out == NULL) {
+        fprintf(stderr, "%s: Error, cannot open %s for writing\n", batchName, outputFile);
+        return -1;
+    }
+    fprintf(out, "file,frame,status,code,type,data,ulx,uly,urx,ury,llx,lly,lrx,lry\n");
+    for (size_t i = 0; i < frames.size(); i++) {
+        const bar_batch_frame &frame = frames[i];
+        if (!frame.readable || frame.codes.empty()) {
+            writeFrameFields(out, inputs[i]);
+            fprintf(out, ",%s,,,,,,,,,,,\n", frame.readable ? "none" : "error");
+            continue;
+        }
+        for (size_t j = 0; j < frame.codes.size(); j++) {
+            const bar_QR_code &code = frame.codes[j];
+            writeFrameFields(out, inputs[i]);
+            fprintf(out, ",ok,%d,", code.id);
+            writeCSVField(out, code.type);
+            fputc(',', out);
+            writeCSVField(out, code.data);
+            for (int k = 0; k < 4; k++) {
+                if (k < code.num_corners)
+                    fprintf(out, ",%d,%d", code.position[k].x, code.position[k].y);
+                else
+                    fprintf(out, ",,");
+            }
+            fputc('\n', out);
+        }
+    }
+    int status = ferror(out) ? -1 : 0;
+    if (fclose(out) != 0) status = -1;
+    if (status != 0) fprintf(stderr, "%s: Error writing %s\n", batchName, outputFile);
+    return status;
+}
+
+//------------------------------------------------------
+// Entry point
+//------------------------------------------------------
+
+extern "C" int NDBarBatchDecode(const char *input, const char *outputFile, int numThreads,
+                                int inverted, int density, int scale, int rotated,
+                                int readHDF5) {
+    if (input == NULL || strlen(input) == 0 || outputFile == NULL || strlen(outputFile) == 0) {
+        fprintf(stderr,
+                "Usage: %s(input dir or list file, output file, threads, inverted, density, "
+                "scale, rotated)\n",
+                batchName);
+        return -1;
+    }
+
+    // same settings as the plugin, recorded frames are decoded in full with no time budget
+    bar_decode_options options = bar_decode_options();
+    options.inverted = inverted;
+    options.expected_codes = 0;
+    options.time_budget = 0.0;
+    options.density = density > 1 ? density : 1;
+    options.scale = scale > 1 ? scale : 1;
+    options.rotated = rotated;
+    options.coarse_passes = 1;
+
+    vector<bar_batch_input> inputs;
+    if (collectInputs(input, inputs, readHDF5 == 1) != 0) return -1;
+
+    if (numThreads <= 0) numThreads = (int) thread::hardware_concurrency();
+    if (numThreads <= 0) numThreads = 1;
+    if ((size_t) numThreads > inputs.size() && !inputs.empty()) numThreads = (int) inputs.size();
+
+    vector<bar_batch_range> ranges;
+    splitInputs(inputs, numThreads, ranges);
+    vector<bar_batch_frame> frames(inputs.size());
+    atomic<size_t> nextRange(0);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int i = 0; i < numThreads; i++) {
+        workers.push_back(
+            thread(batchWorker, &inputs, &ranges, &frames, &nextRange, &options));
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t unreadable = 0, codes = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (!frames[i].readable) unreadable++;
+        codes += frames[i].codes.size();
+    }
+
+    int status = writeResults(outputFile, inputs, frames);
+
+    printf("%s: %lu frames (%lu unreadable), %lu codes in %.3f s with %d threads -> %.1f frames/s\n",
+           batchName, (unsigned long) inputs.size(), (unsigned long) unreadable,
+           (unsigned long) codes, seconds, numThreads, seconds > 0 ? inputs.size() / seconds : 0.0);
+    return status;
+}
@@ -0,0 +1,35 @@
+/*
+ * NDBarBatch.h
+ *
+ * Header file for offline batch decoding of recorded image sets.
+ * Used both by the NDBarBatchDecode IOC shell command and by the
+ * standalone barBatchDecode executable.
+ *
+ * Created on: October 18, 2026
+ */
+
+#ifndef NDBarBatch_H
+#define NDBarBatch_H
+
+/**
+ * Decodes every image in a directory (or every path listed in a text file, one per line)
+ * using a pool of numThreads worker threads, writes a CSV results file, and prints the
+ * achieved throughput in frames/s. HDF5 files contribute one frame per NDArray they hold.
+ *
+ * @params[in]: input      -> directory of images, or text file listing image paths
+ * @params[in]: outputFile -> path of the CSV results file to write
+ * @params[in]: numThreads -> number of decoding threads, <= 0 to use one per core
+ * @params[in]: inverted   -> 1 if the codes are white on black
+ * @params[in]: density    -> spacing between zbar scan lines, <= 1 scans every line
+ * @params[in]: scale      -> factor images are downscaled by before scanning, <= 1 for none
+ * @params[in]: rotated    -> 1 to also search for 1D codes rotated away from the scan lines
+ * @params[in]: readHDF5   -> 1 to read HDF5 files, 0 to skip them. The HDF5 library is
+ *                            normally built without thread safety, so HDF5 files must not be
+ *                            read inside an IOC where NDFileHDF5 may write at the same time
+ * @return: 0 on success, -1 if the inputs could not be read or the output could not be written
+ */
+extern "C" int NDBarBatchDecode(const char *input, const char *outputFile, int numThreads,
+                                int inverted, int density, int scale, int rotated,
+                                int readHDF5);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * NDBarBatchRegister.cpp
+ *
+ * IOC shell registration of the NDBarBatchDecode command. Built into the
+ * NDPluginBarBatch library, so that only IOCs that want offline batch decoding
+ * link it and the image codecs it needs.
+ *
+ * Created on: October 19, 2026
+ */
+
+#include <epicsExport.h>
+#include <iocsh.h>
+
+#include "NDBarBatch.h"
+
+/* IOC shell arguments passed to the offline batch decode function */
+static const iocshArg batchArg0 = {"input dir or list file", iocshArgString};
+static const iocshArg batchArg1 = {"output file", iocshArgString};
+static const iocshArg batchArg2 = {"numThreads", iocshArgInt};
+static const iocshArg batchArg3 = {"inverted", iocshArgInt};
+static const iocshArg batchArg4 = {"density", iocshArgInt};
+static const iocshArg batchArg5 = {"scale", iocshArgInt};
+static const iocshArg batchArg6 = {"rotated", iocshArgInt};
+static const iocshArg *const batchArgs[] = {&batchArg0, &batchArg1, &batchArg2, &batchArg3,
+                                            &batchArg4, &batchArg5, &batchArg6};
+
+/* Definition of the offline batch decode function in the IOC shell */
+static const iocshFuncDef batchFuncDef = {"NDBarBatchDecode", 7, batchArgs};
+
+/* link the batch decode function with the passed args, and call it from the IOC shell. HDF5
+ * files are skipped, as NDFileHDF5 may call the HDF5 library from another thread meanwhile */
+static void batchCallFunc(const iocshArgBuf *args) {
+    NDBarBatchDecode(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].ival,
+                     args[5].ival, args[6].ival, 0);
+}
+
+/* function to register the batch decode function in the IOC shell */
+extern "C" void NDBarBatchRegister(void) { iocshRegister(&batchFuncDef, batchCallFunc); }
+
+/* Exports batch decode registration */
+extern "C" {
+epicsExportRegistrar(NDBarBatchRegister);
+}
@@ -0,0 +1,517 @@
+/*
+ * NDBarDecoder.cpp
+ *
+ * Barcode decoding pipeline used by NDPluginBar for live frames and by
+ * NDBarBatchDecode for recorded image sets.
+ *
+ * The image can be downscaled before scanning, and the spacing of zbar scan lines can be
+ * increased, to trade read rate for speed. When a number of expected codes is given, the
+ * image is scanned coarse to fine with decreasing scan line spacing, stopping as soon as
+ * enough codes are found. Otherwise a single scan is done. With a time budget, each pass scans
+ * the whole image when the time it is expected to take, measured on earlier scans, fits in
+ * what is left of the budget. Only a pass that would overrun is scanned as overlapping strips
+ * of rows, with the budget checked before every strip, as strips can miss codes taller than
+ * their overlap.
+ *
+ * zbar only reads 1D codes along its horizontal and vertical scan lines, so codes rotated
+ * well away from those axes are missed. When rotated codes are enabled, the structure tensor
+ * of the image gradients is used to find regions of strongly oriented gradients, such as the
+ * bars of a 1D code, along with their dominant gradient angle. Each off axis region is then
+ * warped on its own so its bars are vertical, scanned, and the code corners are mapped back
+ * to the original image. This replaces scanning rotated copies of the whole frame.
+ *
+ * Scratch images are kept between frames and only reallocated when the image size changes,
+ * the zbar scanner and image are reused, symbols are read through the zbar C accessors
+ * without copying their data into strings, and results are written into caller provided
+ * fixed size structs. OpenCV and zbar still allocate internally while processing.
+ *
+ * Created on: October 18, 2026
+ */
+
+#include "NDBarDecoder.h"
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace cv;
+using namespace zbar;
+
+// Scan line spacings used from coarse to fine when expected codes are set. Only the ones
+// coarser than the requested density are used, followed by a pass at the requested density
+static const int scanDensities[] = {4, 2};
+#define NUM_SCAN_DENSITIES (int) (sizeof(scanDensities) / sizeof(scanDensities[0]))
+
+// Height of the row strips scanned when a pass would overrun the time budget, and the rows
+// shared by adjacent strips, so that codes up to BUDGET_STRIP_OVERLAP rows tall always lie
+// whole in one strip
+#define BUDGET_STRIP_ROWS 384
+#define BUDGET_STRIP_OVERLAP 128
+
+// Orientation search settings. The structure tensor is smoothed over ORIENT_WINDOW pixels, so
+// that it spans several bars. Pixels are candidates when their gradient energy is at least
+// ORIENT_ENERGY_RATIO times the frame mean, and their coherence is above ORIENT_COHERENCE
+#define ORIENT_WINDOW 15
+#define ORIENT_ENERGY_RATIO 2.0
+#define ORIENT_COHERENCE 0.6
+// Regions smaller than this many pixels are ignored, and at most MAX_ROTATED_REGIONS are warped
+#define ORIENT_MIN_AREA 400
+#define MAX_ROTATED_REGIONS 8
+// Regions within this many degrees of an axis are already read by the normal scan
+#define ORIENT_SKIP_ANGLE 10.0
+// Border in pixels added around each warped region
+#define ORIENT_MARGIN 8
+
+/**
+ * Constructor. Initializes the zbar scanner with all symbologies enabled
+ */
+NDBarDecoder::NDBarDecoder()
+    : lastRotatedRegions(0), lastCoarseMissed(false), scanSecondsPerPixel(0.0) {
+    zbarScanner.set_config(ZBAR_NONE, ZBAR_CFG_ENABLE, 1);
+    zbarImage.set_format("Y800");
+}
+
+/**
+ * Function that returns the number of rotated regions warped and scanned in the last decode
+ */
+int NDBarDecoder::rotated_regions() const {
+    return lastRotatedRegions;
+}
+
+/**
+ * Function that returns true if, in the last decode with expected codes, the coarse passes ran
+ * without finding them all, or were skipped and the pass at the requested density did not find
+ * them all either, so coarse passes could not have. Callers use it to skip the coarse passes
+ * on the frames that follow, which would otherwise add their cost to every frame with fewer
+ * codes in view than expected.
+ */
+bool NDBarDecoder::coarse_passes_missed() const {
+    return lastCoarseMissed;
+}
+
+/**
+ * Function that makes sure a scratch Mat has the given size and type, so that OpenCV
+ * functions writing into it do not reallocate
+ */
+static void ensureScratch(cv::Mat &m, int rows, int cols, int type) {
+    if (m.rows == rows && m.cols == cols && m.type() == type) return;
+    m.create(rows, cols, type);
+}
+
+/**
+ * Function that returns the seconds elapsed since start
+ */
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Function that checks if the time budget, in seconds from start, has run out
+ */
+static bool budgetSpent(std::chrono::steady_clock::time_point start, double budget) {
+    return budget > 0 && secondsSince(start) >= budget;
+}
+
+/**
+ * Function used to use a form of thresholding to reverse the coloration of a bar code
+ * or QR code that is in the white on black format rather than the standard black on white.
+ * The result is written to the scratch image, so the input is left untouched.
+ *
+ * @params[in]: img -> image containing inverse QR code. Required to be 8 bit
+ * @return: 0 if image is 8 bit and was inverted, -1 otherwise
+ */
+int NDBarDecoder::fix_inverted(const Mat &img) {
+    if (img.depth() != CV_8U && img.depth() != CV_8S) {
+        return -1;
+    }
+    subtract(Scalar(255), img, invertedImg);
+    return 0;
+}
+
+/**
+ * Function that copies a zbar symbol into a bar_QR_code struct, truncating the type and
+ * message if needed and subsampling the location points down to MAX_CODE_CORNERS. Locations
+ * are mapped through transform if given, then multiplied by scale to map them back to the
+ * full resolution image
+ */
+static void copy_symbol(const zbar_symbol_t *symbol, int id, int scale,
+                        const Matx23d *transform, bar_QR_code &barQR) {
+    const char *type = zbar_get_symbol_name(zbar_symbol_get_type(symbol));
+    strncpy(barQR.type, type, MAX_CODE_TYPE_LEN - 1);
+    barQR.type[MAX_CODE_TYPE_LEN - 1] = '\0';
+
+    size_t length = zbar_symbol_get_data_length(symbol);
+    if (length > MAX_CODE_DATA_LEN - 1) length = MAX_CODE_DATA_LEN - 1;
+    memcpy(barQR.data, zbar_symbol_get_data(symbol), length);
+    barQR.data[length] = '\0';
+
+    unsigned int locations = zbar_symbol_get_loc_size(symbol);
+    barQR.num_corners = locations < MAX_CODE_CORNERS ? (int) locations : MAX_CODE_CORNERS;
+    for (int i = 0; i < barQR.num_corners; i++) {
+        unsigned int loc = (locations <= MAX_CODE_CORNERS)
+                               ? i
+                               : i * (locations - 1) / (MAX_CODE_CORNERS - 1);
+        double x = zbar_symbol_get_loc_x(symbol, loc);
+        double y = zbar_symbol_get_loc_y(symbol, loc);
+        if (transform != NULL) {
+            const Matx23d &t = *transform;
+            double tx = t(0, 0) * x + t(0, 1) * y + t(0, 2);
+            double ty = t(1, 0) * x + t(1, 1) * y + t(1, 2);
+            x = tx;
+            y = ty;
+        }
+        barQR.position[i] = Point(cvRound(x * scale), cvRound(y * scale));
+    }
+    barQR.id = id;
+}
+
+/**
+ * Function that checks if a code with the same type and message is already stored
+ */
+static bool code_already_found(const bar_QR_code *codes, int numCodes,
+                               const zbar_symbol_t *symbol) {
+    const char *type = zbar_get_symbol_name(zbar_symbol_get_type(symbol));
+    const char *data = zbar_symbol_get_data(symbol);
+    for (int i = 0; i < numCodes; i++) {
+        if (strncmp(codes[i].data, data, MAX_CODE_DATA_LEN - 1) == 0 &&
+            strncmp(codes[i].type, type, MAX_CODE_TYPE_LEN - 1) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Function that runs a single zbar scan over the prepared image, with scan lines spaced
+ * density pixels apart. Symbols not already in codes are appended, up to maxCodes.
+ *
+ * @params[in]: density   -> spacing between scan lines, 1 scans every row and column
+ * @params[in]: scale     -> factor the scanned image was downscaled by
+ * @params[in]: transform -> maps scanned locations into the downscaled image, or NULL
+ * @params[out]: codes    -> storage for at least maxCodes codes
+ * @params[in/out]: numCodes -> number of codes stored, updated with the codes added
+ * @params[in]: maxCodes  -> number of codes that fit in codes
+ * @return: number of symbols found by this pass, including ones that did not fit
+ */
+int NDBarDecoder::scan_pass(int density, int scale, const Matx23d *transform,
+                            bar_QR_code *codes, int *numCodes, int maxCodes) {
+    zbarScanner.set_config(ZBAR_NONE, ZBAR_CFG_X_DENSITY, density);
+    zbarScanner.set_config(ZBAR_NONE, ZBAR_CFG_Y_DENSITY, density);
+    zbarScanner.scan(zbarImage);
+
+    // the C accessors are used, as the C++ symbol iterator copies each payload into a string
+    int counter = 0;
+    for (const zbar_symbol_t *symbol = zbar_image_first_symbol(zbarImage); symbol != NULL;
+         symbol = zbar_symbol_next(symbol)) {
+        counter++;
+        if (*numCodes >= maxCodes || code_already_found(codes, *numCodes, symbol)) continue;
+        copy_symbol(symbol, *numCodes, scale, transform, codes[*numCodes]);
+        (*numCodes)++;
+    }
+    return counter;
+}
+
+/**
+ * Function that scans rows y0 to y0 + rows of a continuous image, wrapping them in place, and
+ * updates the measured scan time per pixel. Slower scans are taken up at once, and faster
+ * ones gradually, so that a cluttered frame is not followed by an optimistic estimate.
+ *
+ * @params[in]: img      -> continuous 8 bit image to scan
+ * @params[in]: y0       -> first row to scan
+ * @params[in]: rows     -> number of rows to scan
+ * @params[in]: density  -> spacing between scan lines, 1 scans every row and column
+ * @params[in]: scale    -> factor img was downscaled by
+ * @params[out]: codes   -> storage for at least maxCodes codes
+ * @params[in/out]: numCodes -> number of codes stored, updated with the codes added
+ * @params[in]: maxCodes -> number of codes that fit in codes
+ * @return: number of symbols found, including ones that did not fit
+ */
+int NDBarDecoder::scan_rows(const Mat &img, int y0, int rows, int density, int scale,
+                            bar_QR_code *codes, int *numCodes, int maxCodes) {
+    std::chrono::steady_clock::time_point scanStart = std::chrono::steady_clock::now();
+    Matx23d shift(1, 0, 0, 0, 1, y0);
+    zbarImage.set_size(img.cols, rows);
+    zbarImage.set_data(img.ptr(y0), img.cols * rows);
+    int symbols = scan_pass(density, scale, y0 > 0 ? &shift : NULL, codes, numCodes, maxCodes);
+
+    double perPixel = secondsSince(scanStart) * density / ((double) img.cols * rows);
+    if (perPixel > scanSecondsPerPixel)
+        scanSecondsPerPixel = perPixel;
+    else
+        scanSecondsPerPixel = 0.9 * scanSecondsPerPixel + 0.1 * perPixel;
+    return symbols;
+}
+
+/**
+ * Function that scans the image at one scan line density. The whole image is scanned at once,
+ * unless a time budget is set and the scan is expected to outlast what is left of it, from
+ * the time per pixel measured on earlier scans. Then, and before anything has been measured,
+ * the image is scanned in overlapping strips of rows, checked against the budget before each
+ * strip. Strips are kept for that case only, as a code taller than the overlap can be split
+ * between them and missed. Scanning also stops once the expected number of codes is found.
+ *
+ * @params[in]: img      -> continuous 8 bit image to scan
+ * @params[in]: density  -> spacing between scan lines, 1 scans every row and column
+ * @params[in]: options  -> expected code count and time budget
+ * @params[in]: start    -> time decoding of the frame started
+ * @params[in]: scale    -> factor img was downscaled by
+ * @params[out]: codes   -> storage for at least maxCodes codes
+ * @params[in/out]: numCodes -> number of codes stored, updated with the codes added
+ * @params[in]: maxCodes -> number of codes that fit in codes
+ * @params[out]: partial -> set if the time budget ran out before the whole image was scanned
+ * @return: largest number of symbols found in one scan, including ones that did not fit
+ */
+int NDBarDecoder::scan_strips(const Mat &img, int density, const bar_decode_options &options,
+                              std::chrono::steady_clock::time_point start, int scale,
+                              bar_QR_code *codes, int *numCodes, int maxCodes, bool *partial) {
+    if (budgetSpent(start, options.time_budget)) {
+        *partial = true;
+        return 0;
+    }
+    double expected = scanSecondsPerPixel * img.cols * img.rows / density;
+    if (options.time_budget <= 0 || img.rows <= BUDGET_STRIP_ROWS ||
+        (scanSecondsPerPixel > 0 && secondsSince(start) + expected <= options.time_budget)) {
+        return scan_rows(img, 0, img.rows, density, scale, codes, numCodes, maxCodes);
+    }
+
+    int symbols = 0;
+    for (int y0 = 0;; y0 += BUDGET_STRIP_ROWS - BUDGET_STRIP_OVERLAP) {
+        int rows = std::min(BUDGET_STRIP_ROWS, img.rows - y0);
+        symbols = std::max(symbols,
+                           scan_rows(img, y0, rows, density, scale, codes, numCodes, maxCodes));
+
+        if (y0 + rows >= img.rows) break;
+        if (options.expected_codes > 0 && std::max(symbols, *numCodes) >= options.expected_codes)
+            break;
+        if (budgetSpent(start, options.time_budget)) {
+            *partial = true;
+            break;
+        }
+    }
+    return symbols;
+}
+
+/**
+ * Function that finds regions of the image where the gradients are strong and share one
+ * direction, as across the bars of a 1D code. The structure tensor products of the Sobel
+ * gradients are smoothed over a window, pixels with high energy and coherence are marked,
+ * and the marked pixels are grouped into connected regions. For each region the bounding box
+ * and the summed tensor are stored in regions, indexed by label.
+ *
+ * @params[in]: img -> 8 bit grayscale image to search
+ * @return: number of labels, including the background label 0
+ */
+int NDBarDecoder::find_oriented_regions(const Mat &img) {
+    int rows = img.rows, cols = img.cols;
+    ensureScratch(gradX, rows, cols, CV_32F);
+    ensureScratch(gradY, rows, cols, CV_32F);
+    ensureScratch(tensorProduct, rows, cols, CV_32F);
+    ensureScratch(tensorXX, rows, cols, CV_32F);
+    ensureScratch(tensorYY, rows, cols, CV_32F);
+    ensureScratch(tensorXY, rows, cols, CV_32F);
+    ensureScratch(orientMask, rows, cols, CV_8U);
+    ensureScratch(orientLabels, rows, cols, CV_32S);
+
+    Sobel(img, gradX, CV_32F, 1, 0, 3);
+    Sobel(img, gradY, CV_32F, 0, 1, 3);
+    Size window(ORIENT_WINDOW, ORIENT_WINDOW);
+    multiply(gradX, gradX, tensorProduct);
+    boxFilter(tensorProduct, tensorXX, -1, window);
+    multiply(gradY, gradY, tensorProduct);
+    boxFilter(tensorProduct, tensorYY, -1, window);
+    multiply(gradX, gradY, tensorProduct);
+    boxFilter(tensorProduct, tensorXY, -1, window);
+
+    // coherence is (l1 - l2) / (l1 + l2) for the tensor eigenvalues, 1 for perfectly
+    // parallel gradients and 0 for gradients in all directions
+    double minEnergy = ORIENT_ENERGY_RATIO * (mean(tensorXX)[0] + mean(tensorYY)[0]);
+    for (int y = 0; y < rows; y++) {
+        const float *xx = tensorXX.ptr<float>(y);
+        const float *yy = tensorYY.ptr<float>(y);
+        const float *xy = tensorXY.ptr<float>(y);
+        uchar *mask = orientMask.ptr<uchar>(y);
+        for (int x = 0; x < cols; x++) {
+            double energy = xx[x] + yy[x];
+            double diff = xx[x] - yy[x];
+            double anisotropy = sqrt(diff * diff + 4.0 * xy[x] * xy[x]);
+            mask[x] = (energy > minEnergy && anisotropy > ORIENT_COHERENCE * energy) ? 255 : 0;
+        }
+    }
+
+    int numLabels = connectedComponents(orientMask, orientLabels, 8, CV_32S);
+    bar_orient_region empty = {INT_MAX, INT_MAX, -1, -1, 0, 0.0, 0.0, 0.0};
+    regions.assign(numLabels, empty);
+    for (int y = 0; y < rows; y++) {
+        const int *labels = orientLabels.ptr<int>(y);
+        const float *xx = tensorXX.ptr<float>(y);
+        const float *yy = tensorYY.ptr<float>(y);
+        const float *xy = tensorXY.ptr<float>(y);
+        for (int x = 0; x < cols; x++) {
+            if (labels[x] == 0) continue;
+            bar_orient_region &region = regions[labels[x]];
+            region.min_x = std::min(region.min_x, x);
+            region.min_y = std::min(region.min_y, y);
+            region.max_x = std::max(region.max_x, x);
+            region.max_y = std::max(region.max_y, y);
+            region.area++;
+            region.jxx += xx[x];
+            region.jyy += yy[x];
+            region.jxy += xy[x];
+        }
+    }
+    return numLabels;
+}
+
+/**
+ * Function that checks if a code already found lies in a region, so it is not scanned again
+ */
+static bool region_already_read(const bar_orient_region &region, int scale,
+                                const bar_QR_code *codes, int numCodes) {
+    for (int i = 0; i < numCodes; i++) {
+        for (int j = 0; j < codes[i].num_corners; j++) {
+            int x = codes[i].position[j].x / scale, y = codes[i].position[j].y / scale;
+            if (x >= region.min_x && x <= region.max_x && y >= region.min_y &&
+                y <= region.max_y)
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Function that looks for 1D codes rotated away from the zbar scan directions. The dominant
+ * gradient angle of each candidate region is taken from its summed structure tensor, and
+ * regions already close to an axis, or holding a code that was already read, are skipped.
+ * Each remaining region is rotated about its center so that its gradients are horizontal,
+ * warped into a patch just large enough to hold it, and scanned. Code locations are mapped
+ * back through the inverse rotation.
+ *
+ * @params[in]: img      -> prepared image the normal passes scanned
+ * @params[in]: options  -> expected code count and time budget
+ * @params[in]: start    -> time decoding of the frame started
+ * @params[in]: scale    -> factor img was downscaled by
+ * @params[out]: codes   -> storage for at least maxCodes codes
+ * @params[in/out]: numCodes -> number of codes stored, updated with the codes added
+ * @params[in]: maxCodes -> number of codes that fit in codes
+ * @params[out]: partial -> set if the time budget ran out before all regions were scanned
+ * @return: number of symbols found by the last region scanned, including ones that did not fit
+ */
+int NDBarDecoder::scan_rotated(const Mat &img, const bar_decode_options &options,
+                               std::chrono::steady_clock::time_point start, int scale,
+                               bar_QR_code *codes, int *numCodes, int maxCodes, bool *partial) {
+    if (budgetSpent(start, options.time_budget)) {
+        *partial = true;
+        return 0;
+    }
+    int numLabels = find_oriented_regions(img);
+    int symbols = 0;
+    for (int label = 1; label < numLabels && lastRotatedRegions < MAX_ROTATED_REGIONS; label++) {
+        const bar_orient_region &region = regions[label];
+        if (region.area < ORIENT_MIN_AREA) continue;
+
+        // angle of the dominant gradient direction, measured the same way as OpenCV rotations
+        double angle = 0.5 * atan2(2.0 * region.jxy, region.jxx - region.jyy) * 180.0 / CV_PI;
+        if (fabs(angle - 90.0 * cvRound(angle / 90.0)) < ORIENT_SKIP_ANGLE) continue;
+        if (region_already_read(region, scale, codes, *numCodes)) continue;
+        if (options.expected_codes > 0 && *numCodes >= options.expected_codes) break;
+        if (budgetSpent(start, options.time_budget)) {
+            *partial = true;
+            break;
+        }
+
+        // rotation about the region center that turns the gradients horizontal, as
+        // getRotationMatrix2D, shifted so the rotated region lands in the middle of the patch
+        double radians = angle * CV_PI / 180.0;
+        double a = cos(radians), b = sin(radians);
+        double cx = (region.min_x + region.max_x) / 2.0, cy = (region.min_y + region.max_y) / 2.0;
+        int w = region.max_x - region.min_x + 1, h = region.max_y - region.min_y + 1;
+        int patchW = (int) ceil(fabs(a) * w + fabs(b) * h) + 2 * ORIENT_MARGIN;
+        int patchH = (int) ceil(fabs(b) * w + fabs(a) * h) + 2 * ORIENT_MARGIN;
+        double tx = patchW / 2.0 - (a * cx + b * cy);
+        double ty = patchH / 2.0 - (-b * cx + a * cy);
+        Matx23d warp(a, b, tx, -b, a, ty);
+        Matx23d inverse(a, -b, b * ty - a * tx, b, a, -b * tx - a * ty);
+
+        if (patchBuffer.total() < (size_t) patchW * patchH)
+            patchBuffer.create(1, patchW * patchH, CV_8UC1);
+        Mat patch(patchH, patchW, CV_8UC1, patchBuffer.data);
+        warpAffine(img, patch, warp, patch.size(), INTER_LINEAR, BORDER_REPLICATE);
+        lastRotatedRegions++;
+
+        zbarImage.set_size(patchW, patchH);
+        zbarImage.set_data(patch.data, patchW * patchH);
+        symbols = scan_pass(1, scale, &inverse, codes, numCodes, maxCodes);
+    }
+    return symbols;
+}
+
+/**
+ * Function that does the barcode decoding. The Mat is wrapped by the reused zbar Image
+ * object, and then it is scanned by zbar. Each discovered symbol is copied into the next
+ * caller provided struct.
+ *
+ * The image is first downscaled by options.scale if set, and code locations are mapped back
+ * to full resolution. If options.expected_codes is set, the image is scanned coarse to fine,
+ * unless options.coarse_passes is 0, and scanning stops once that many codes have been found.
+ * If the time budget runs out, the codes found so far are returned and partial is set. A pass
+ * expected to overrun the budget is scanned in strips, with the budget checked between them.
+ * If options.rotated is set and more codes may be present, off axis 1D codes are then searched
+ * for region by region, within the same budget.
+ *
+ * @params[in]: img      -> 8 bit grayscale image to scan
+ * @params[in]: options  -> inversion, expected code count, time budget, density and scale
+ * @params[out]: codes   -> storage for at least maxCodes codes
+ * @params[in]: maxCodes -> number of codes that fit in codes. Extra codes are counted only
+ * @params[out]: partial -> set if scanning was cut short by the time budget
+ * @return: number of codes found, which may exceed maxCodes, or -1 if the image could not be
+ * inverted
+ */
+int NDBarDecoder::decode_bar_codes(const Mat &img, const bar_decode_options &options,
+                                   bar_QR_code *codes, int maxCodes, bool *partial) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    *partial = false;
+    lastRotatedRegions = 0;
+    lastCoarseMissed = false;
+
+    const Mat *scanImg = &img;
+    int scale = 1;
+    if (options.scale > 1 && img.cols >= options.scale && img.rows >= options.scale) {
+        scale = options.scale;
+        resize(img, scaledImg, Size(img.cols / scale, img.rows / scale), 0, 0, INTER_AREA);
+        scanImg = &scaledImg;
+    }
+    if (options.inverted == 1) {
+        if (fix_inverted(*scanImg) != 0) return -1;
+        scanImg = &invertedImg;
+    }
+
+    // without an expected count there is nothing to stop early for, so do one pass
+    int density = options.density > 1 ? options.density : 1;
+    int numCodes = 0, found = 0;
+    bool coarseRun = false;
+    for (int pass = 0; pass <= NUM_SCAN_DENSITIES && !*partial; pass++) {
+        bool finalPass = (pass == NUM_SCAN_DENSITIES);
+        if (!finalPass && (options.expected_codes <= 0 || options.coarse_passes == 0 ||
+                           scanDensities[pass] <= density))
+            continue;
+        int symbols = scan_strips(*scanImg, finalPass ? density : scanDensities[pass], options,
+                                  start, scale, codes, &numCodes, maxCodes, partial);
+        found = std::max(found, std::max(symbols, numCodes));
+        if (options.expected_codes > 0 && found >= options.expected_codes) break;
+        if (!finalPass) coarseRun = true;
+        // the coarse passes were either tried without success, or would not have succeeded
+        if (finalPass && options.expected_codes > 0) lastCoarseMissed = true;
+    }
+    // skipped coarse passes may have been enough when the pass at density was
+    if (!coarseRun && found >= options.expected_codes) lastCoarseMissed = false;
+
+    if (options.rotated == 1 && !*partial &&
+        !(options.expected_codes > 0 && found >= options.expected_codes)) {
+        int symbols = scan_rotated(*scanImg, options, start, scale, codes, &numCodes, maxCodes,
+                                   partial);
+        found = std::max(found, std::max(symbols, numCodes));
+    }
+    return found;
+}
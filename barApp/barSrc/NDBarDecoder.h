@@ -0,0 +1,132 @@
+/*
+ * NDBarDecoder.h
+ *
+ * Header file for the barcode decoding pipeline shared by NDPluginBar and
+ * the offline batch decoder. Has no EPICS dependencies so that it can be
+ * linked into standalone executables.
+ *
+ * Created on: October 18, 2026
+ */
+
+#ifndef NDBarDecoder_H
+#define NDBarDecoder_H
+
+#include <zbar.h>
+
+#include <chrono>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Maximum lengths of the type name and message stored for each code, including terminator.
+// The message length matches NELM of the BarcodeMessage waveform records
+#define MAX_CODE_TYPE_LEN 32
+#define MAX_CODE_DATA_LEN 256
+
+// Maximum number of location points stored for each code. QR codes report 4, 1D codes
+// report one per scan line crossing them, and are subsampled down to this many
+#define MAX_CODE_CORNERS 16
+
+/* structure that contains information about the bar/QR code, fixed size so it can be reused */
+typedef struct {
+    char type[MAX_CODE_TYPE_LEN];
+    char data[MAX_CODE_DATA_LEN];
+    cv::Point position[MAX_CODE_CORNERS];
+    int num_corners;
+    int id;
+} bar_QR_code;
+
+/* Options controlling how much work is done decoding a single image */
+typedef struct {
+    // flag for white on black codes
+    int inverted;
+    // stop scanning once this many codes have been found, 0 to always scan fully
+    int expected_codes;
+    // time allowed for decoding in seconds, 0 for no limit
+    double time_budget;
+    // spacing between zbar scan lines in the finest pass, 1 scans every row and column
+    int density;
+    // integer factor the image is downscaled by before scanning, 1 for full resolution
+    int scale;
+    // flag to also look for rotated 1D codes, warping each candidate region to horizontal
+    int rotated;
+    // flag to scan coarse to fine when expected_codes is set, 0 scans only at density
+    int coarse_passes;
+} bar_decode_options;
+
+/* Candidate barcode region found by the orientation search: bounding box, pixel count and
+ * the structure tensor summed over the region */
+typedef struct {
+    int min_x, min_y, max_x, max_y;
+    int area;
+    double jxx, jyy, jxy;
+} bar_orient_region;
+
+/*
+ * Class that wraps the zbar scanner and the image preparation steps needed before
+ * scanning. Each instance owns its own scanner and scratch image, which are reused between
+ * frames, so one instance must be used per thread.
+ */
+class NDBarDecoder {
+   public:
+    NDBarDecoder();
+
+    // inverts white on black codes, scans the image and fills codes with the results
+    int decode_bar_codes(const cv::Mat &img, const bar_decode_options &options,
+                         bar_QR_code *codes, int maxCodes, bool *partial);
+
+    // returns the number of rotated regions warped and scanned in the last call to decode
+    int rotated_regions() const;
+
+    // returns true if coarse passes could not have found the expected codes in the last decode
+    bool coarse_passes_missed() const;
+
+   private:
+    zbar::ImageScanner zbarScanner;
+    zbar::Image zbarImage;
+
+    // scratch images holding the downscaled and inverted copies of the input
+    cv::Mat scaledImg;
+    cv::Mat invertedImg;
+
+    // scratch images for the orientation search: gradients, structure tensor products and
+    // their smoothed sums, the mask of strongly oriented pixels and its connected regions
+    cv::Mat gradX, gradY, tensorProduct;
+    cv::Mat tensorXX, tensorYY, tensorXY;
+    cv::Mat orientMask, orientLabels;
+    std::vector<bar_orient_region> regions;
+    // storage for the warped region, only grown, so patches of any smaller size fit
+    cv::Mat patchBuffer;
+
+    int lastRotatedRegions;
+    bool lastCoarseMissed;
+
+    // measured zbar scan time in seconds per pixel at density 1, 0 until the first scan
+    double scanSecondsPerPixel;
+
+    // function that allows for reading inverted barcodes
+    int fix_inverted(const cv::Mat &img);
+
+    // scans the image at one scan line density, adding codes not already found. Locations are
+    // mapped through transform first if given
+    int scan_pass(int density, int scale, const cv::Matx23d *transform, bar_QR_code *codes,
+                  int *numCodes, int maxCodes);
+
+    // scans rows of the image at one density, timing the scan
+    int scan_rows(const cv::Mat &img, int y0, int rows, int density, int scale, bar_QR_code *codes,
+                  int *numCodes, int maxCodes);
+
+    // scans the image at one density, in strips of rows if it would overrun the time budget
+    int scan_strips(const cv::Mat &img, int density, const bar_decode_options &options,
+                    std::chrono::steady_clock::time_point start, int scale, bar_QR_code *codes,
+                    int *numCodes, int maxCodes, bool *partial);
+
+    // finds regions of strongly oriented gradients, returns the number of labels
+    int find_oriented_regions(const cv::Mat &img);
+
+    // warps each off axis candidate region to horizontal and scans it
+    int scan_rotated(const cv::Mat &img, const bar_decode_options &options,
+                     std::chrono::steady_clock::time_point start, int scale, bar_QR_code *codes,
+                     int *numCodes, int maxCodes, bool *partial);
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * NDBarManifest.cpp
+ *
+ * Sample manifest lookup for NDPluginBar. The manifest is a CSV file with
+ * a header line, followed by one line per sample. The first column holds the
+ * barcode payload, and the remaining columns are ignored. Data rows are
+ * numbered from 0, empty lines and lines starting with '#' are skipped.
+ *
+ * Created on: October 18, 2026
+ */
+
+#include "NDBarManifest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+
+using namespace std;
+
+// Largest manifest accepted, so that row numbers always fit the hash table entries
+#define MAX_MANIFEST_ROWS 10000000
+
+/**
+ * FNV-1a hash of a payload
+ */
+static uint32_t hashPayload(const char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Function that extracts the first field of a CSV line. Quoted fields may contain commas, and
+ * doubled quotes inside them stand for a single quote. Surrounding spaces of unquoted fields
+ * are removed.
+ */
+static string firstCSVField(const string &line) {
+    string field;
+    size_t i = 0;
+    if (!line.empty() && line[0] == '"') {
+        for (i = 1; i < line.size(); i++) {
+            if (line[i] == '"') {
+                if (i + 1 < line.size() && line[i + 1] == '"') {
+                    field += '"';
+                    i++;
+                } else {
+                    break;
+                }
+            } else {
+                field += line[i];
+            }
+        }
+        return field;
+    }
+    size_t end = line.find(',');
+    field = line.substr(0, end);
+    size_t first = field.find_first_not_of(" \t");
+    if (first == string::npos) return "";
+    return field.substr(first, field.find_last_not_of(" \t") - first + 1);
+}
+
+NDBarManifest::NDBarManifest() : slotMask(0) {}
+
+/**
+ * Function that loads a manifest file into a new index. The whole file is read before the
+ * index is built, so the table is sized once and never rehashed.
+ *
+ * @params[in]: fileName -> path of the CSV manifest
+ * @params[out]: message -> number of rows loaded, or the reason loading failed
+ * @return: the new manifest, owned by the caller, or NULL if the file could not be loaded
+ */
+NDBarManifest *NDBarManifest::load(const char *fileName, string &message) {
+    char text[512];
+    ifstream file(fileName);
+    if (!file) {
+        snprintf(text, sizeof(text), "Cannot open %s", fileName);
+        message = text;
+        return NULL;
+    }
+
+    vector<string> payloads;
+    string line;
+    bool header = true;
+    while (getline(file, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        if (line.empty() || line[0] == '#') continue;
+        if (header) {
+            header = false;
+            continue;
+        }
+        if (payloads.size() >= MAX_MANIFEST_ROWS) {
+            snprintf(text, sizeof(text), "More than %d rows in %s", MAX_MANIFEST_ROWS, fileName);
+            message = text;
+            return NULL;
+        }
+        payloads.push_back(firstCSVField(line));
+    }
+
+    NDBarManifest *manifest = new NDBarManifest();
+    size_t numSlots = 16;
+    while (numSlots < 2 * payloads.size()) numSlots *= 2;
+    manifest->slots.assign(numSlots, 0);
+    manifest->slotMask = (uint32_t) numSlots - 1;
+    manifest->keyOffsets.reserve(payloads.size() + 1);
+    manifest->keyOffsets.push_back(0);
+
+    int duplicates = 0;
+    for (size_t i = 0; i < payloads.size(); i++) {
+        if (!manifest->insert(payloads[i])) duplicates++;
+    }
+
+    if (duplicates > 0)
+        snprintf(text, sizeof(text), "Loaded %d rows, %d duplicate payloads ignored",
+                 manifest->rows(), duplicates);
+    else
+        snprintf(text, sizeof(text), "Loaded %d rows", manifest->rows());
+    message = text;
+    return manifest;
+}
+
+/**
+ * Function that adds the next row to the index. Rows with a payload that is already listed
+ * still take up a row number, so row numbers always match the file, but only the first
+ * row with a given payload can be found.
+ *
+ * @params[in]: payload -> barcode payload of the row
+ * @return: false if the payload was already listed, true otherwise
+ */
+bool NDBarManifest::insert(const string &payload) {
+    uint32_t row = (uint32_t) rows();
+    keys.insert(keys.end(), payload.begin(), payload.end());
+    keyOffsets.push_back((uint32_t) keys.size());
+
+    if (lookup(payload.c_str()) >= 0) return false;
+    uint32_t slot = hashPayload(payload.data(), payload.size()) & slotMask;
+    while (slots[slot] != 0) slot = (slot + 1) & slotMask;
+    slots[slot] = row + 1;
+    return true;
+}
+
+/**
+ * Function that finds the manifest row of a decoded payload, by linear probing from the slot
+ * given by its hash until a matching payload or an empty slot is found.
+ *
+ * @params[in]: payload -> decoded barcode payload
+ * @return: row of the payload, counting data rows from 0, or -1 if it is not listed
+ */
+int NDBarManifest::lookup(const char *payload) const {
+    size_t length = strlen(payload);
+    uint32_t slot = hashPayload(payload, length) & slotMask;
+    while (slots[slot] != 0) {
+        uint32_t row = slots[slot] - 1;
+        uint32_t start = keyOffsets[row];
+        if (keyOffsets[row + 1] - start == length &&
+            memcmp(keys.data() + start, payload, length) == 0)
+            return (int) row;
+        slot = (slot + 1) & slotMask;
+    }
+    return -1;
+}
+
+/**
+ * Function that returns the number of data rows in the manifest
+ */
+int NDBarManifest::rows() const {
+    return (int) keyOffsets.size() - 1;
+}
@@ -0,0 +1,51 @@
+/*
+ * NDBarManifest.h
+ *
+ * Header file for the sample manifest used by NDPluginBar to look up which
+ * sample a decoded barcode belongs to. The manifest is loaded from a local
+ * CSV file into a compact hash index, which is never modified once built,
+ * so it can be shared by all decoding threads without locking.
+ *
+ * Created on: October 18, 2026
+ */
+
+#ifndef NDBarManifest_H
+#define NDBarManifest_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * Immutable index from barcode payload to manifest row. The payloads are packed into a single
+ * buffer, and an open addressing table of row numbers, at most half full, indexes them by hash.
+ * A new manifest is loaded into a new instance, and swapped in whole by the plugin.
+ */
+class NDBarManifest {
+   public:
+    // loads a manifest file, returns NULL on failure. message describes the result either way
+    static NDBarManifest *load(const char *fileName, std::string &message);
+
+    // returns the row of payload in the manifest, or -1 if it is not listed
+    int lookup(const char *payload) const;
+
+    // number of data rows in the manifest
+    int rows() const;
+
+   private:
+    NDBarManifest();
+
+    // payloads of all rows back to back, row i spans keyOffsets[i] to keyOffsets[i + 1]
+    std::vector<char> keys;
+    std::vector<uint32_t> keyOffsets;
+
+    // hash table of row + 1 for each slot, 0 for empty slots. Size is a power of 2
+    std::vector<uint32_t> slots;
+    uint32_t slotMask;
+
+    // adds a row to the index, returns false if the payload is already listed
+    bool insert(const std::string &payload);
+};
+
+#endif
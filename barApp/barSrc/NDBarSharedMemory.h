@@ -0,0 +1,126 @@
+/*
+ * NDBarSharedMemory.h
+ *
+ * Layout of the POSIX shared memory region NDPluginBar can export its results
+ * to, so that processes on the same host can read barcode positions without
+ * Channel Access. Plain C, with no EPICS dependencies, so readers only need
+ * this header.
+ *
+ * The region holds a ring of NDBAR_SHM_SLOTS fixed size records, one per
+ * decoded frame. Each record is protected by its own sequence counter, which
+ * is odd while the plugin writes it. A reader takes the newest slot, and keeps
+ * what it read only if the counter was even and unchanged across the read,
+ * and the record is still the one the write count pointed to. As the plugin
+ * writes to the slot after the newest one, a reader has several frame periods
+ * to read a record before it can be overwritten.
+ *
+ * Created on: October 18, 2026
+ */
+
+#ifndef NDBarSharedMemory_H
+#define NDBarSharedMemory_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define NDBAR_SHM_MAGIC 0x4E444252u /* "NDBR" */
+#define NDBAR_SHM_VERSION 2
+
+/* Number of records in the ring */
+#define NDBAR_SHM_SLOTS 8
+
+/* Codes stored per record, and the length of their type and payload, including terminator */
+#define NDBAR_SHM_MAX_CODES 5
+#define NDBAR_SHM_TYPE_LEN 32
+#define NDBAR_SHM_DATA_LEN 256
+
+/* A decoded code. Corners are in image pixels, with y measured from the bottom of the image,
+ * as in the corner PVs. Type and data are always null terminated, and truncated if needed */
+typedef struct {
+    char type[NDBAR_SHM_TYPE_LEN];
+    char data[NDBAR_SHM_DATA_LEN];
+    /* row in the sample manifest, -1 if unknown or no manifest is loaded */
+    int32_t manifest_row;
+    /* number of valid corners, 1D codes may have fewer than 4 */
+    int32_t num_corners;
+    int32_t corner_x[4];
+    int32_t corner_y[4];
+} NDBarShmCode;
+
+/* Results for one frame */
+typedef struct {
+    /* odd while the record is being written */
+    uint32_t sequence;
+    /* input source the frame came from, the asyn address of the plugin */
+    int32_t source;
+    /* uniqueId of the NDArray */
+    int32_t unique_id;
+    /* number of codes found, and number stored in codes, at most NDBAR_SHM_MAX_CODES */
+    int32_t num_codes;
+    int32_t num_stored;
+    /* size of the decoded image */
+    int32_t image_width;
+    int32_t image_height;
+    uint32_t reserved;
+    /* write count of the region once this record is published, 1 for the first record */
+    uint64_t write_index;
+    /* timeStamp of the NDArray, and its EPICS time stamp */
+    double timestamp;
+    uint32_t epics_sec;
+    uint32_t epics_nsec;
+    NDBarShmCode codes[NDBAR_SHM_MAX_CODES];
+} NDBarShmRecord;
+
+/* The whole shared memory region */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t num_slots;
+    /* total number of records written, the newest is in slot (write_count - 1) % num_slots */
+    uint64_t write_count;
+    NDBarShmRecord slots[NDBAR_SHM_SLOTS];
+} NDBarShmRegion;
+
+/**
+ * Checks that a mapped region was created with this version of the layout
+ *
+ * @return: 1 if the layout matches, 0 otherwise
+ */
+static inline int ndbar_shm_valid(const NDBarShmRegion *region) {
+    return region->magic == NDBAR_SHM_MAGIC && region->version == NDBAR_SHM_VERSION &&
+           region->record_size == sizeof(NDBarShmRecord) && region->num_slots == NDBAR_SHM_SLOTS;
+}
+
+/* The reader helper uses the GCC atomic builtins, available with gcc and clang */
+#if defined(__GNUC__)
+/**
+ * Copies the newest record out of the region, retrying if the plugin writes it meanwhile.
+ * The sequence alone cannot tell if the plugin wrapped the ring between loading the write
+ * count and reading the slot, which leaves a newer record in it with an even sequence, so
+ * the write index of the copy must also match the count. Readers that only need a few
+ * fields can instead read them in place, and check the slot in the same way before using
+ * them.
+ *
+ * @params[in]: region  -> mapped shared memory region
+ * @params[out]: record -> receives a consistent copy of the newest record
+ * @return: write count of the record returned, 0 if nothing has been written yet
+ */
+static inline uint64_t ndbar_shm_read_latest(const NDBarShmRegion *region,
+                                             NDBarShmRecord *record) {
+    for (;;) {
+        uint64_t count = __atomic_load_n(&region->write_count, __ATOMIC_ACQUIRE);
+        if (count == 0) return 0;
+        const NDBarShmRecord *slot = &region->slots[(count - 1) % NDBAR_SHM_SLOTS];
+        uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) continue;
+        memcpy(record, slot, sizeof(NDBarShmRecord));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before &&
+            record->write_index == count)
+            return count;
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * NDBarShmExport.cpp
+ *
+ * Writer side of the shared memory export of NDPluginBar results. The region
+ * is created with shm_open and left in place when the export is closed, so
+ * that readers can keep it mapped across plugin restarts. An flock on the
+ * descriptor keeps two writers from sharing a region.
+ *
+ * Created on: October 18, 2026
+ */
+
+#include "NDBarShmExport.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BAR_SHM_POSIX
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+NDBarShmExport::NDBarShmExport() : fd(-1), region(NULL), current(NULL) {}
+
+NDBarShmExport::~NDBarShmExport() {
+    close();
+}
+
+/**
+ * Function that creates, or opens if it exists, the named shared memory region, locks it and
+ * maps it. Fails if another writer holds the lock. A region left by an earlier run with the
+ * same layout keeps its write count, so readers that stayed attached see the count keep
+ * increasing. Otherwise the region is cleared.
+ *
+ * @params[in]: name     -> POSIX shared memory name, starting with '/'
+ * @params[out]: message -> describes the result
+ * @return: 0 if the region is mapped, -1 otherwise
+ */
+int NDBarShmExport::open(const char *name, string &message) {
+    char text[512];
+    close();
+#ifdef BAR_SHM_POSIX
+    fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        snprintf(text, sizeof(text), "shm_open %s failed: %s", name, strerror(errno));
+        message = text;
+        return -1;
+    }
+    // held until close, readers do not take it
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        if (errno == EWOULDBLOCK)
+            snprintf(text, sizeof(text), "%s is in use by another writer", name);
+        else
+            snprintf(text, sizeof(text), "Locking %s failed: %s", name, strerror(errno));
+        message = text;
+        close();
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(NDBarShmRegion)) != 0) {
+        snprintf(text, sizeof(text), "Resizing %s failed: %s", name, strerror(errno));
+        message = text;
+        close();
+        return -1;
+    }
+    void *mapped =
+        mmap(NULL, sizeof(NDBarShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        snprintf(text, sizeof(text), "Mapping %s failed: %s", name, strerror(errno));
+        message = text;
+        close();
+        return -1;
+    }
+    region = (NDBarShmRegion *) mapped;
+    if (!ndbar_shm_valid(region)) {
+        memset(region, 0, sizeof(NDBarShmRegion));
+        region->record_size = sizeof(NDBarShmRecord);
+        region->num_slots = NDBAR_SHM_SLOTS;
+        region->version = NDBAR_SHM_VERSION;
+        __atomic_store_n(&region->magic, NDBAR_SHM_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        // a record left half written by a previous run must not later look complete
+        for (int i = 0; i < NDBAR_SHM_SLOTS; i++) {
+            if (region->slots[i].sequence & 1) region->slots[i].sequence++;
+        }
+    }
+    snprintf(text, sizeof(text), "Exporting to %s", name);
+    message = text;
+    return 0;
+#else
+    snprintf(text, sizeof(text), "Shared memory export is not supported on this platform");
+    message = text;
+    return -1;
+#endif
+}
+
+/**
+ * Function that unmaps the region and releases its lock. The region itself is not removed
+ */
+void NDBarShmExport::close() {
+#ifdef BAR_SHM_POSIX
+    if (region != NULL) munmap(region, sizeof(NDBarShmRegion));
+    // closing the descriptor also releases the lock
+    if (fd >= 0) ::close(fd);
+#endif
+    fd = -1;
+    region = NULL;
+    current = NULL;
+}
+
+bool NDBarShmExport::is_open() const {
+    return region != NULL;
+}
+
+/**
+ * Function that returns the slot after the newest one, with its sequence made odd so readers
+ * know it is being written, and its write index set to the count it will be published as.
+ * The fence keeps the record contents from being written before the sequence. The GCC atomic
+ * builtins are only used where the region can be mapped.
+ *
+ * @return: record to fill, or NULL if the region is not mapped
+ */
+NDBarShmRecord *NDBarShmExport::begin_record() {
+#ifdef BAR_SHM_POSIX
+    if (region == NULL) return NULL;
+    current = &region->slots[region->write_count % NDBAR_SHM_SLOTS];
+    __atomic_store_n(&current->sequence, current->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    current->write_index = region->write_count + 1;
+    return current;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Function that makes the sequence of the record being written even again, and then
+ * publishes it as the newest record
+ */
+void NDBarShmExport::end_record() {
+#ifdef BAR_SHM_POSIX
+    if (current == NULL) return;
+    __atomic_store_n(&current->sequence, current->sequence + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&region->write_count, region->write_count + 1, __ATOMIC_RELEASE);
+#endif
+    current = NULL;
+}
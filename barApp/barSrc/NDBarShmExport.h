@@ -0,0 +1,45 @@
+/*
+ * NDBarShmExport.h
+ *
+ * Header file for the writer side of the shared memory export of NDPluginBar
+ * results. The layout of the region is defined in NDBarSharedMemory.h.
+ *
+ * Created on: October 18, 2026
+ */
+
+#ifndef NDBarShmExport_H
+#define NDBarShmExport_H
+
+#include <string>
+
+#include "NDBarSharedMemory.h"
+
+/*
+ * Class that creates and maps a named POSIX shared memory region, and writes records into
+ * its ring. Records are filled in place between begin_record and end_record, so no extra copy
+ * is made. The descriptor is kept open with an exclusive lock while the region is mapped, so
+ * a second writer of the same name, in this or another IOC, fails to open it. Calls must be
+ * serialized by the caller.
+ */
+class NDBarShmExport {
+   public:
+    NDBarShmExport();
+    ~NDBarShmExport();
+
+    // creates or opens the region and maps it, message describes the result either way
+    int open(const char *name, std::string &message);
+    void close();
+    bool is_open() const;
+
+    // returns the next slot of the ring, marked as being written
+    NDBarShmRecord *begin_record();
+    // marks the slot returned by begin_record as complete, and publishes it as the newest
+    void end_record();
+
+   private:
+    int fd;
+    NDBarShmRegion *region;
+    NDBarShmRecord *current;
+};
+
+#endif
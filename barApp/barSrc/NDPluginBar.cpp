@@ -18,16 +18,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <iostream>
 
 // include epics/area detector libraries
 #include <epicsExport.h>
 #include <epicsMutex.h>
 #include <epicsString.h>
+#include <epicsTime.h>
 #include <iocsh.h>
 
 #include "NDArray.h"
+#include "NDBarShmExport.h"
 #include "NDPluginBar.h"
+#ifdef BAR_COUNT_ALLOCATIONS
+#include "NDBarAllocCount.h"
+#endif
 
 // OpenCV is used for image manipulation, zbar for barcode detection
 #include <zbar.h>
@@ -41,6 +47,19 @@ using namespace zbar;
 
 static const char *driverName = "NDPluginBar";
 
+// Decoder settings stepped through by auto-tune, from most thorough to cheapest
+static const struct {
+    int density;
+    int scale;
+} tuneLevels[] = {{1, 1}, {2, 1}, {2, 2}, {4, 2}};
+#define NUM_TUNE_LEVELS (int) (sizeof(tuneLevels) / sizeof(tuneLevels[0]))
+
+// Number of windows auto-tune waits before stepping cheaper again after backing off
+#define TUNE_HOLD_WINDOWS 10
+
+// Number of frames decoded without coarse passes after a frame that needed the full pass
+#define COARSE_SKIP_FRAMES 16
+
 //------------------------------------------------------
 // Functions called at init
 //------------------------------------------------------
@@ -69,6 +88,18 @@ asynStatus NDPluginBar::initPVArrays() {
     cornerYPVs[2] = NDPluginBarLowerLeftY;
     cornerYPVs[3] = NDPluginBarLowerRightY;
 
+    sampleRowPVs[0] = NDPluginBarSampleRow1;
+    sampleRowPVs[1] = NDPluginBarSampleRow2;
+    sampleRowPVs[2] = NDPluginBarSampleRow3;
+    sampleRowPVs[3] = NDPluginBarSampleRow4;
+    sampleRowPVs[4] = NDPluginBarSampleRow5;
+
+    sampleKnownPVs[0] = NDPluginBarSampleKnown1;
+    sampleKnownPVs[1] = NDPluginBarSampleKnown2;
+    sampleKnownPVs[2] = NDPluginBarSampleKnown3;
+    sampleKnownPVs[3] = NDPluginBarSampleKnown4;
+    sampleKnownPVs[4] = NDPluginBarSampleKnown5;
+
     return asynSuccess;
 }
 
@@ -85,21 +116,23 @@ void NDPluginBar::printCVError(cv::Exception &e, const char *functionName) {
 }
 
 /**
- * Function that clears out the currently detected barcodes.
+ * Function that clears out the currently detected barcodes of a source.
  */
-asynStatus NDPluginBar::clearPreviousCodes() {
-    codes_in_image.clear();
-    setIntegerParam(NDPluginBarNumberCodes, 0);
+asynStatus NDPluginBar::clearPreviousCodes(int source) {
+    sources[source].num_codes_in_image = 0;
+    setIntegerParam(source, NDPluginBarNumberCodes, 0);
     return asynSuccess;
 }
 
 /**
- * Function that checks if barcode was already discovered
+ * Function that checks if barcode was already discovered in the last frame from a source
  */
-int NDPluginBar::codePreviouslyFound(bar_QR_code barQR) {
+int NDPluginBar::codePreviouslyFound(int source, const bar_QR_code &barQR) {
+    const NDBarSource &src = sources[source];
     int i;
-    for (i = 0; i < codes_in_image.size(); i++) {
-        if (codes_in_image[i].data == barQR.data && codes_in_image[i].id == barQR.id) {
+    for (i = 0; i < src.num_codes_in_image; i++) {
+        if (strcmp(src.codes_in_image[i].data, barQR.data) == 0 &&
+            src.codes_in_image[i].id == barQR.id) {
             return i;
         }
     }
@@ -116,14 +149,17 @@ int NDPluginBar::codePreviouslyFound(bar_QR_code barQR) {
  * Image types
  *
  * If the image is in RGB, it is converted to grayscale before it is passed to the plugin, because
- * zbar requires a grayscale image for detection
+ * zbar requires a grayscale image for detection. The conversion is written into the per thread
+ * scratch Mat, which is only reallocated when the image dimensions change.
  *
  * @params[in]: pArray	-> pointer to an NDArray
  * @params[in]: arrayInfo -> pointer to info about NDArray
- * @params[out]: img	-> smart pointer to output Mat
+ * @params[out]: img	-> output Mat, either a header on the NDArray data or the scratch Mat
+ * @params[in]: scratch -> per thread scratch storage
  * @return: success if able to convert, error otherwise
  */
-asynStatus NDPluginBar::ndArray2Mat(NDArray *pArray, NDArrayInfo *arrayInfo, Mat &img) {
+asynStatus NDPluginBar::ndArray2Mat(NDArray *pArray, NDArrayInfo *arrayInfo, Mat &img,
+                                    NDBarScratch &scratch) {
     const char *functionName = "ndArray2Mat";
     // data type and num dimensions used during conversion
     NDDataType_t dataType = pArray->dataType;
@@ -163,7 +199,8 @@ asynStatus NDPluginBar::ndArray2Mat(NDArray *pArray, NDArrayInfo *arrayInfo, Mat
     try {
         // image must be converted to grayscale before barcode processing
         if (img.channels() != 1) {
-            cvtColor(img, img, COLOR_RGB2GRAY);
+            cvtColor(img, scratch.gray, COLOR_RGB2GRAY);
+            img = scratch.gray;
         }
     } catch (cv::Exception &e) {
         printCVError(e, functionName);
@@ -173,226 +210,324 @@ asynStatus NDPluginBar::ndArray2Mat(NDArray *pArray, NDArrayInfo *arrayInfo, Mat
 }
 
 /**
- * Function that converts Mat back into NDArray. This function is guaranteed to
- * have either a 8 bit or 16 bit color image, because the bounding boxes drawn
+ * Function that converts the grayscale Mat into the output NDArray. This function is
+ * guaranteed to have either a 8 bit or 16 bit color image, because the bounding boxes drawn
  * around the detected barcodes are blue. The rest of the image will appear
- * black and white, but the actual color mode will be RGB
+ * black and white, but the actual color mode will be RGB.
+ *
+ * The conversion is written straight into the NDArray memory through a Mat header,
+ * so no intermediate RGB Mat is allocated or copied.
  *
  * @params[out]: pScratch -> output NDArray
- * @params[in]: img	-> Mat with barcode bounding boxes drawn
+ * @params[in]: img	-> grayscale Mat the codes were decoded from
+ * @params[out]: out -> Mat header on the output NDArray data, for drawing bounding boxes
  * @return: success if converted correctly, error otherwise
  */
-asynStatus NDPluginBar::mat2NDArray(NDArray *pScratch, Mat &img) {
-    const char *functionName = "mat2NDArray";
+asynStatus NDPluginBar::gray2NDArray(NDArray *pScratch, Mat &img, Mat &out) {
+    const char *functionName = "gray2NDArray";
 
     NDArrayInfo arrayInfo;
     pScratch->getInfo(&arrayInfo);
 
-    size_t dataSize = img.step[0] * img.rows;
+    out = Mat(img.rows, img.cols, CV_MAKETYPE(img.depth(), 3), pScratch->pData);
+    size_t dataSize = out.step[0] * out.rows;
 
     if (dataSize != arrayInfo.totalBytes) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s Error, invalid array size\n",
                   driverName, functionName);
-        img.release();
         return asynError;
     }
 
-    memcpy((unsigned char *) pScratch->pData, (unsigned char *) img.data, dataSize);
-    // now that data is copied to NDArray, we don't need mat anymore
-    img.release();
-    return asynSuccess;
-}
-
-/**
- * Function used to use a form of thresholding to reverse the coloration of a bar code
- * or QR code that is in the white on black format rather than the standard black on white
- *
- * @params[out]: img -> image containing inverse QR code. Required to be 8 bit
- * @return: status -> if image is 8 bit, then invert it and success, otherwise, error
- */
-asynStatus NDPluginBar::fix_inverted(Mat &img) {
-    if (img.depth() != CV_8U || img.depth() != CV_8S) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                  "%s::%s Error, only 8 bit images support inversion\n", driverName,
-                  "fix_inverted");
+    try {
+        // destination already has the right size and type, so nothing is allocated
+        cvtColor(img, out, COLOR_GRAY2RGB);
+    } catch (cv::Exception &e) {
+        printCVError(e, functionName);
         return asynError;
     }
-    subtract(Scalar(255), img, img);
     return asynSuccess;
 }
 
 /**
- * Function that is used simply to offload the process of setting the PV values
- * of the detected corners. It takes the current detected bar code, assignes the values of
- * the corners to the struct, and then, if it is the first detected code, sets PV vals
+ * Function that returns the array to write the output image into. Each thread keeps its last
+ * NUM_OUTPUT_ARRAYS output arrays, and reuses one once downstream plugins and the base class
+ * have released it. Its attributes are then still in place, and adding them again only
+ * updates their values, so a warm thread takes no new array or attributes from the heap.
+ * While all kept arrays are still in use, a new array is taken from the pool. Kept arrays of
+ * another size, or from another plugin instance sharing the thread, are returned to their pool.
  *
- * @params[out]:  discovered 	-> struct contatining discovered bar or QR code
- * @params[in]:  symbol 		-> current discovered code
- * @params[in]:  update_corners -> flag to see if it is the first detected code
- * @return: status
+ * @params[in/out]: scratch -> per thread scratch storage holding the kept arrays
+ * @params[in]: dims        -> dimensions of the output array
+ * @params[in]: dataType    -> data type of the output array
+ * @return: array with a reference for the caller, or NULL if the pool could not allocate one
  */
-asynStatus NDPluginBar::push_corners(bar_QR_code &discovered, Image::SymbolIterator &symbol,
-                                     int update_corners, int imgHeight) {
-    discovered.position.clear();
-    for (int i = 0; i < symbol->get_location_size(); i++) {
-        discovered.position.push_back(Point(symbol->get_location_x(i), symbol->get_location_y(i)));
+NDArray *NDPluginBar::takeOutputArray(NDBarScratch &scratch, size_t *dims,
+                                      NDDataType_t dataType) {
+    int i, empty = -1;
+    for (i = 0; i < NUM_OUTPUT_ARRAYS; i++) {
+        NDArray *pOut = scratch.outputs[i];
+        if (pOut != NULL) {
+            // only this thread still holds it, so nothing else can be reading it
+            if (pOut->getReferenceCount() > 1) continue;
+            if (pOut->pNDArrayPool == pNDArrayPool && pOut->dataType == dataType &&
+                pOut->ndims == 3 && pOut->dims[0].size == dims[0] &&
+                pOut->dims[1].size == dims[1] && pOut->dims[2].size == dims[2]) {
+                pOut->reserve();
+                return pOut;
+            }
+            pOut->release();
+            scratch.outputs[i] = NULL;
+        }
+        if (empty < 0) empty = i;
     }
-    if (update_corners == 1) {
-        updateCorners(discovered, imgHeight);
+
+    NDArray *pOut = pNDArrayPool->alloc(3, dims, dataType, 0, NULL);
+    if (pOut != NULL && empty >= 0) {
+        pOut->reserve();
+        scratch.outputs[empty] = pOut;
     }
-    return asynSuccess;
+    return pOut;
 }
 
 /**
  * Function that updates corner coordinate PVs to those of
- * a specific detected bar code
+ * a specific detected bar code. Codes with fewer than 4 location points
+ * report 0 for the missing corners
  *
+ * @params[in]: source		-> source the code was found by, the asyn address of the PVs
  * @params[in]: discovered	-> code from which we want corner info
+ * @params[in]: imgHeight	-> height of the image, as y is measured from the bottom
  * @return: status
  */
-asynStatus NDPluginBar::updateCorners(bar_QR_code &discovered, int imgHeight) {
+asynStatus NDPluginBar::updateCorners(int source, const bar_QR_code &discovered, int imgHeight) {
     // const char* functionName = "updateCorners";
-    int sizeY;
-    getIntegerParam(NDArraySizeY, &sizeY);
     int i;
     for (i = 0; i < 4; i++) {
-        if (i == 0) {
-            setIntegerParam(NDPluginBarUpperLeftX, discovered.position[i].x);
-            setIntegerParam(NDPluginBarUpperLeftY, imgHeight - discovered.position[i].y);
-        } else if (i == 1) {
-            setIntegerParam(NDPluginBarUpperRightX, discovered.position[i].x);
-            setIntegerParam(NDPluginBarUpperRightY, imgHeight - discovered.position[i].y);
-        } else if (i == 2) {
-            setIntegerParam(NDPluginBarLowerLeftX, discovered.position[i].x);
-            setIntegerParam(NDPluginBarLowerLeftY, imgHeight - discovered.position[i].y);
-        } else if (i == 3) {
-            setIntegerParam(NDPluginBarLowerRightX, discovered.position[i].x);
-            setIntegerParam(NDPluginBarLowerRightY, imgHeight - discovered.position[i].y);
+        if (i < discovered.num_corners) {
+            setIntegerParam(source, cornerXPVs[i], discovered.position[i].x);
+            setIntegerParam(source, cornerYPVs[i], imgHeight - discovered.position[i].y);
+        } else {
+            setIntegerParam(source, cornerXPVs[i], 0);
+            setIntegerParam(source, cornerYPVs[i], 0);
         }
     }
     return asynSuccess;
 }
 
 /**
- * Function that uses zbar to scan image for barcodes
+ * Function that clears any non-overwritten barcode PVs between array callbacks
  *
- * @params[in]: img -> input image in Mat format
- * @return: Image -> new image object with scanned symbols
+ * @params[in]: source  -> source the image came from
+ * @params[in]: counter -> number of codes detected in the new image
+ * @return: success if set correctly otherwise error
  */
-Image NDPluginBar::scan_image(Mat &img) {
-    // initialize the image and the scanner object
-    ImageScanner zbarScanner;
-    zbarScanner.set_config(ZBAR_NONE, ZBAR_CFG_ENABLE, 1);
-    Image scannedImage(img.cols, img.rows, "Y800", (uchar *) img.data, img.cols * img.rows);
+asynStatus NDPluginBar::clearUnusedBarcodePvs(int source, int counter) {
+    // const char* functionName = "clear_unused_barcode_pvs";
+    int i;
+    for (i = counter; i < NUM_CODES; i++) {
+        asynStatus s1 = setStringParam(source, barcodeMessagePVs[i], "No Barcode Found");
+        asynStatus s2 = setStringParam(source, barcodeTypePVs[i], "None");
+        if (s1 == asynError || s2 == asynError) return asynError;
+    }
+    return asynSuccess;
+}
 
-    // scan the image with the zbar scanner
-    zbarScanner.scan(scannedImage);
+/**
+ * Function that does the barcode decoding. The image is passed to the per thread NDBarDecoder,
+ * which inverts it if required and scans it with zbar, stopping early once the expected number
+ * of codes is found or the time budget runs out. If enabled, off axis regions are then warped
+ * and scanned for rotated 1D codes. Each code is looked up in the manifest the frame started
+ * with. Results are written into the per thread scratch storage; no PVs are touched, so this
+ * can be called without holding the lock.
+ *
+ * @params[in]: img      -> the opencv image generated by converting the NDArray
+ * @params[in]: options  -> inversion, expected code count, time budget and rotated code search
+ * @params[out]: scratch -> per thread scratch storage receiving the codes
+ * @return: error if the image could not be inverted, otherwise success
+ */
+asynStatus NDPluginBar::decode_bar_codes(Mat &img, const bar_decode_options &options,
+                                         NDBarScratch &scratch) {
+    const char *functionName = "decode_bar_codes";
+    epicsTimeStamp start, end;
+
+    epicsTimeGetCurrent(&start);
+    scratch.num_found =
+        scratch.decoder.decode_bar_codes(img, options, scratch.codes, NUM_CODES, &scratch.partial);
+    epicsTimeGetCurrent(&end);
+    scratch.decode_time = epicsTimeDiffInSeconds(&end, &start) * 1000.0;
+    scratch.rotated_regions = scratch.decoder.rotated_regions();
+    scratch.coarse_missed = scratch.decoder.coarse_passes_missed();
+    if (scratch.num_found < 0) {
+        scratch.num_found = 0;
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s::%s Error, only 8 bit images support inversion\n", driverName,
+                  functionName);
+        return asynError;
+    }
 
-    return scannedImage;
+    // the manifest is immutable, so lookups need no lock
+    int stored = scratch.num_found < NUM_CODES ? scratch.num_found : NUM_CODES;
+    const NDBarManifest *pManifest = scratch.manifest.get();
+    for (int i = 0; i < stored; i++) {
+        scratch.sample_rows[i] = pManifest ? pManifest->lookup(scratch.codes[i].data) : -1;
+    }
+    return asynSuccess;
 }
 
 /**
- * Function that clears any non-overwritten barcode PVs between array callbacks
+ * Function that pushes the codes decoded in the current frame to the PVs. Must be called with
+ * the lock held. Message and type PVs are only rewritten when the set of codes changes, and
+ * keep their last values when no codes are in view. The corner PVs track the selected code.
+ * The manifest row and known flag of each code are published with it, and the mismatch
+ * alarm is raised while any code in view is missing from the loaded manifest.
  *
- * @params[in]: counter -> number of codes detected in the new image
- * @return: success if set correctly otherwise error
+ * @params[in]: source    -> source the image came from, the asyn address of the PVs
+ * @params[in]: scratch   -> per thread scratch storage holding the decoded codes
+ * @params[in]: imgHeight -> height of the decoded image
+ * @return: status
  */
-asynStatus NDPluginBar::clearUnusedBarcodePvs(int counter) {
-    // const char* functionName = "clear_unused_barcode_pvs";
+asynStatus NDPluginBar::publish_bar_codes(int source, NDBarScratch &scratch, int imgHeight) {
+    NDBarSource &src = sources[source];
+    int stored = scratch.num_found < NUM_CODES ? scratch.num_found : NUM_CODES;
     int i;
-    for (i = counter; i < NUM_CODES; i++) {
-        asynStatus s1 = setStringParam(barcodeMessagePVs[i], "No Barcode Found");
-        asynStatus s2 = setStringParam(barcodeTypePVs[i], "None");
-        if (s1 == asynError || s2 == asynError) return asynError;
+
+    setIntegerParam(source, NDPluginBarNumberCodes, scratch.num_found);
+    bool mismatch = false;
+    for (i = 0; i < stored; i++) {
+        if (scratch.manifest && scratch.sample_rows[i] < 0) mismatch = true;
+    }
+    setIntegerParam(source, NDPluginBarSampleMismatch, mismatch ? 1 : 0);
+    if (stored == 0) return asynSuccess;
+
+    for (i = 0; i < NUM_CODES; i++) {
+        int row = i < stored ? scratch.sample_rows[i] : -1;
+        setIntegerParam(source, sampleRowPVs[i], row);
+        setIntegerParam(source, sampleKnownPVs[i], row >= 0 ? 1 : 0);
+    }
+
+    bool changed = (stored != src.num_codes_in_image);
+    for (i = 0; i < stored && !changed; i++) {
+        changed = codePreviouslyFound(source, scratch.codes[i]) != i;
+    }
+
+    if (changed) {
+        for (i = 0; i < stored; i++) {
+            setStringParam(source, barcodeTypePVs[i], scratch.codes[i].type);
+            setStringParam(source, barcodeMessagePVs[i], scratch.codes[i].data);
+        }
+        clearUnusedBarcodePvs(source, stored);
+    }
+    // copy positions as well, so that moving codes are tracked
+    memcpy(src.codes_in_image, scratch.codes, stored * sizeof(bar_QR_code));
+    src.num_codes_in_image = stored;
+    src.codes_image_height = imgHeight;
+
+    int code_corners;
+    getIntegerParam(source, NDPluginBarCodeCorners, &code_corners);
+    if (code_corners >= 0 && code_corners < src.num_codes_in_image) {
+        updateCorners(source, src.codes_in_image[code_corners], imgHeight);
     }
     return asynSuccess;
 }
 
 /**
- * Function that does the barcode decoding. It is passed an image and a vector
- * that will store all of the codes found in the image. A zbar scanner is initialized.
- * The image is changed from an opencv to a Image object, and then it is scanned by zbar.
- * We then iterate over the discovered symbols in the image, and create a instance of the
- * struct. the struct is added to the vector, and the bars location data and type are
- * stored, and printed. Additionally, we populate the associated PVs
- *
- * @params[in]: im -> the opencv image generated by converting the NDArray
+ * Function that writes the results of a frame into the next record of the shared memory
+ * region, if the export is enabled. Called with the lock held, right after the results are
+ * published to the PVs, so both always describe the same frame.
+ *
+ * @params[in]: source  -> source the image came from
+ * @params[in]: pArray  -> NDArray the codes were decoded from
+ * @params[in]: scratch -> per thread scratch storage holding the decoded codes
+ * @params[in]: imgSize -> size of the decoded image
  * @return: void
  */
-asynStatus NDPluginBar::decode_bar_codes(Mat &img) {
-    // static const char* functionName = "decode_bar_codes";
-
-    // first scan the image for barcodes
-    Image scannedImage = scan_image(img);
-
-    // counter for number of codes in current image
-    int counter = 0;
-    bool newCodeFound = false;
-    setIntegerParam(NDPluginBarNumberCodes, 0);
-
-    for (Image::SymbolIterator symbol = scannedImage.symbol_begin();
-         symbol != scannedImage.symbol_end(); ++symbol) {
-        // get information from detected bar code and populate a bar_QR_code struct
-        bar_QR_code barQR;
-        barQR.type = symbol->get_type_name();
-        barQR.data = symbol->get_data();
-        barQR.id = counter;
-
-        int found = codePreviouslyFound(barQR);
-        if (found < 0) {
-            if (!newCodeFound) {
-                clearPreviousCodes();
-                clearUnusedBarcodePvs(counter);
-            }
-            newCodeFound = true;
-            // set PVs
-            setStringParam(barcodeTypePVs[counter], barQR.type);
-            setStringParam(barcodeMessagePVs[counter], barQR.data);
-            // iterate the number of discovered codes
-            int code_corners;
-            getIntegerParam(NDPluginBarCodeCorners, &code_corners);
-            // only the first code has its coordinates saved
-            if (counter == code_corners) {
-                // push location data
-                push_corners(barQR, symbol, 1, img.size().height);
-            } else {
-                push_corners(barQR, symbol, 0, img.size().height);
-            }
-            codes_in_image.push_back(barQR);
-        } else {
-            push_corners(codes_in_image[found], symbol, 0, img.size().height);
+void NDPluginBar::export_bar_codes(int source, NDArray *pArray, NDBarScratch &scratch,
+                                   Size imgSize) {
+    if (!shmExport->is_open()) return;
+    int stored = scratch.num_found < NDBAR_SHM_MAX_CODES ? scratch.num_found : NDBAR_SHM_MAX_CODES;
+    int i, j;
+
+    NDBarShmRecord *record = shmExport->begin_record();
+    record->source = source;
+    record->unique_id = pArray->uniqueId;
+    record->num_codes = scratch.num_found;
+    record->num_stored = stored;
+    record->image_width = imgSize.width;
+    record->image_height = imgSize.height;
+    record->timestamp = pArray->timeStamp;
+    record->epics_sec = pArray->epicsTS.secPastEpoch;
+    record->epics_nsec = pArray->epicsTS.nsec;
+    for (i = 0; i < stored; i++) {
+        const bar_QR_code &code = scratch.codes[i];
+        NDBarShmCode &out = record->codes[i];
+        strncpy(out.type, code.type, NDBAR_SHM_TYPE_LEN - 1);
+        out.type[NDBAR_SHM_TYPE_LEN - 1] = '\0';
+        strncpy(out.data, code.data, NDBAR_SHM_DATA_LEN - 1);
+        out.data[NDBAR_SHM_DATA_LEN - 1] = '\0';
+        out.manifest_row = scratch.sample_rows[i];
+        out.num_corners = code.num_corners < 4 ? code.num_corners : 4;
+        for (j = 0; j < 4; j++) {
+            out.corner_x[j] = j < out.num_corners ? code.position[j].x : 0;
+            out.corner_y[j] = j < out.num_corners ? imgSize.height - code.position[j].y : 0;
         }
-        int num_codes = 0;
-        getIntegerParam(NDPluginBarNumberCodes, &num_codes);
-        num_codes = num_codes + 1;
-        setIntegerParam(NDPluginBarNumberCodes, num_codes);
-        counter++;
     }
+    shmExport->end_record();
+}
 
-    return asynSuccess;
+/* Cross product of the vectors o->a and o->b, positive for a counter-clockwise turn */
+static long hullCross(const Point &o, const Point &a, const Point &b) {
+    return (long) (a.x - o.x) * (b.y - o.y) - (long) (a.y - o.y) * (b.x - o.x);
+}
+
+/**
+ * Function that computes the convex hull of a set of points into a fixed size array,
+ * using the monotone chain algorithm, so that drawing does not need to allocate.
+ *
+ * @params[in]: points -> input points, at most MAX_CODE_CORNERS
+ * @params[in]: n      -> number of input points
+ * @params[out]: hull  -> hull vertices in order, must hold 2 * MAX_CODE_CORNERS points
+ * @return: number of hull vertices
+ */
+static int fixedConvexHull(const Point *points, int n, Point *hull) {
+    Point sorted[MAX_CODE_CORNERS];
+    int i, k = 0;
+    for (i = 0; i < n; i++) sorted[i] = points[i];
+    sort(sorted, sorted + n,
+         [](const Point &a, const Point &b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+    // lower hull, then upper hull
+    for (i = 0; i < n; i++) {
+        while (k >= 2 && hullCross(hull[k - 2], hull[k - 1], sorted[i]) <= 0) k--;
+        hull[k++] = sorted[i];
+    }
+    int lower = k + 1;
+    for (i = n - 2; i >= 0; i--) {
+        while (k >= lower && hullCross(hull[k - 2], hull[k - 1], sorted[i]) <= 0) k--;
+        hull[k++] = sorted[i];
+    }
+    return k - 1;
 }
 
 /* Function that uses opencv methods with the locations of the discovered codes to place
  * bounding boxes around the areas of the image that contain barcodes. This is
  * so the user can confirm that the correct area of the image was discovered
  *
- * TODO: Change this function to pipe coordinate information back into NDArray
- *
  * @params[out]: img -> image in which the barcode was discovered
- * @params[in]: codes_in_image -> all barcodes detected in the image
+ * @params[in]: scratch -> per thread scratch storage holding the codes found in the image
  * @return: status
  */
-asynStatus NDPluginBar::show_bar_codes(Mat &img) {
+asynStatus NDPluginBar::show_bar_codes(Mat &img, NDBarScratch &scratch) {
     const char *functionName = "show_bar_codes";
+    int stored = scratch.num_found < NUM_CODES ? scratch.num_found : NUM_CODES;
+    Point hull[2 * MAX_CODE_CORNERS];
     try {
-        for (unsigned int i = 0; i < codes_in_image.size(); i++) {
-            vector<Point> barPoints = codes_in_image[i].position;
-            vector<Point> outside;
-            if (barPoints.size() > 4)
-                convexHull(barPoints, outside);
-            else
-                outside = barPoints;
-            int n = outside.size();
+        for (int i = 0; i < stored; i++) {
+            const bar_QR_code &barQR = scratch.codes[i];
+            const Point *outside = barQR.position;
+            int n = barQR.num_corners;
+            if (n > 4) {
+                n = fixedConvexHull(barQR.position, n, hull);
+                outside = hull;
+            }
             for (int j = 0; j < n; j++) {
                 line(img, outside[j], outside[(j + 1) % n], Scalar(0, 0, 255), 3);
             }
@@ -406,30 +541,26 @@ asynStatus NDPluginBar::show_bar_codes(Mat &img) {
 
 /**
  * Function called on each image recieved from the camera that performs the actual barcode scanning
- * and decoding. First, checks if code is inverted, and if so inverts it. Then, it calls the
- * decode_bar_codes function which searches for barcodes in the image. If they were found without
- * error, barcodes are then drawn onto the Mat. Then the mat is coinverted to the output image.
+ * and decoding. It calls the decode_bar_codes function which searches for barcodes in the image,
+ * inverting it first if required. The grayscale image is then converted into the output
+ * image, and if decoding succeeded, barcodes are drawn onto it.
  *
  * @params[in]: img         -> Mat converted from NDArray sent to plugin in process callbacks
+ * @params[in]: options     -> inversion, expected code count and time budget
  * @params[out]: pArrayOut  -> NDArray the plugin returns in endProcessCallbacks
+ * @params[out]: scratch    -> per thread scratch storage receiving the codes
  * @return asynSuccess if processed correctly, asynError otherwise
  */
-asynStatus NDPluginBar::barcode_image_callback(Mat &img, NDArray *pArrayOut) {
+asynStatus NDPluginBar::barcode_image_callback(Mat &img, const bar_decode_options &options,
+                                               NDArray *pArrayOut, NDBarScratch &scratch) {
     const char *functionName = "barcode_image_callback";
-    // check to see if we need to invert barcode
     asynStatus status;
-    int inverted_code;
-    getIntegerParam(NDPluginBarInvertedBarcode, &inverted_code);
+    Mat out;
 
-    if (inverted_code == 1) {
-        status = fix_inverted(img);
-        if (status != asynError) status = decode_bar_codes(img);
-    } else {
-        status = decode_bar_codes(img);
-    }
-    cvtColor(img, img, COLOR_GRAY2RGB);
-    if (status != asynError) status = show_bar_codes(img);
-    status = mat2NDArray(pArrayOut, img);
+    status = decode_bar_codes(img, options, scratch);
+    asynStatus outStatus = gray2NDArray(pArrayOut, img, out);
+    if (status != asynError && outStatus != asynError) status = show_bar_codes(out, scratch);
+    if (outStatus == asynError) status = asynError;
     if (status == asynError) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
                   "%s::%s Error, image not processed correctly\n", driverName, functionName);
@@ -437,9 +568,404 @@ asynStatus NDPluginBar::barcode_image_callback(Mat &img, NDArray *pArrayOut) {
     return status;
 }
 
+//------------------------------------------------------
+// Auto-tune functions
+//------------------------------------------------------
+
+/**
+ * Function that publishes the decoder settings to use for the next frames, either the manual
+ * ScanDensity and ScaleFactor settings, or those of the current auto-tune level.
+ * Each source is tuned separately.
+ *
+ * @params[in]: source -> source to publish the settings for
+ * @return: status
+ */
+asynStatus NDPluginBar::applyDecodeSettings(int source) {
+    const NDBarSource &src = sources[source];
+    int auto_tune, density, scale;
+    getIntegerParam(source, NDPluginBarAutoTune, &auto_tune);
+    if (auto_tune == 1) {
+        density = tuneLevels[src.tune_level].density;
+        scale = tuneLevels[src.tune_level].scale;
+    } else {
+        getIntegerParam(source, NDPluginBarScanDensity, &density);
+        getIntegerParam(source, NDPluginBarScaleFactor, &scale);
+    }
+    setIntegerParam(source, NDPluginBarAutoTuneLevel, src.tune_level);
+    setIntegerParam(source, NDPluginBarActiveScanDensity, density < 1 ? 1 : density);
+    setIntegerParam(source, NDPluginBarActiveScaleFactor, scale < 1 ? 1 : scale);
+    return asynSuccess;
+}
+
+/**
+ * Function that restarts auto-tune of a source from the most thorough settings, with an
+ * empty window
+ *
+ * @params[in]: source -> source to restart auto-tune for
+ * @return: status
+ */
+asynStatus NDPluginBar::resetAutoTune(int source) {
+    NDBarSource &src = sources[source];
+    src.tune_level = 0;
+    src.tune_frames = 0;
+    src.tune_hits = 0;
+    src.tune_time = 0;
+    src.tune_hold = 0;
+    return applyDecodeSettings(source);
+}
+
+/**
+ * Function that records the result of a frame for auto-tune, and steps the decoder settings.
+ * A frame is a hit when at least the expected number of codes, or one code if none are
+ * expected, was found. At the end of each window with a hit rate at or above the target, the
+ * next cheaper settings are tried. As soon as the misses in a window mean the target can no
+ * longer be met, the settings back off one level, and stay there for TUNE_HOLD_WINDOWS
+ * windows. Must be called with the lock held.
+ *
+ * @params[in]: source   -> source the frame came from
+ * @params[in]: scratch  -> per thread scratch storage holding the results of the frame
+ * @params[in]: expected -> number of codes expected per frame
+ * @return: status
+ */
+asynStatus NDPluginBar::update_auto_tune(int source, NDBarScratch &scratch, int expected) {
+    NDBarSource &src = sources[source];
+    int auto_tune, window;
+    double target;
+    getIntegerParam(source, NDPluginBarAutoTune, &auto_tune);
+    if (auto_tune != 1) return asynSuccess;
+    getIntegerParam(source, NDPluginBarAutoTuneWindow, &window);
+    getDoubleParam(source, NDPluginBarAutoTuneTarget, &target);
+    if (window < 1) window = 1;
+
+    src.tune_frames++;
+    if (scratch.num_found >= (expected > 0 ? expected : 1)) src.tune_hits++;
+    src.tune_time += scratch.decode_time;
+
+    int allowed_misses = (int) floor(window * (100.0 - target) / 100.0);
+    bool backOff = (src.tune_frames - src.tune_hits) > allowed_misses;
+    if (!backOff && src.tune_frames < window) return asynSuccess;
+
+    setDoubleParam(source, NDPluginBarAutoTuneHitRate, 100.0 * src.tune_hits / src.tune_frames);
+    setDoubleParam(source, NDPluginBarAutoTuneDecodeTime, src.tune_time / src.tune_frames);
+    if (backOff) {
+        // reads are failing, so do not wait for the end of the window
+        if (src.tune_level > 0) src.tune_level--;
+        src.tune_hold = TUNE_HOLD_WINDOWS;
+    } else if (src.tune_hold > 0) {
+        src.tune_hold--;
+    } else if (src.tune_level < NUM_TUNE_LEVELS - 1) {
+        src.tune_level++;
+    }
+    src.tune_frames = 0;
+    src.tune_hits = 0;
+    src.tune_time = 0;
+    return applyDecodeSettings(source);
+}
+
+//------------------------------------------------------
+// Input source functions
+//------------------------------------------------------
+
+/* Interrupt callback registered with the NDArray port of each source */
+static void barDriverCallback(void *drvPvt, asynUser *pasynUser, void *genericPointer) {
+    NDPluginBar *pPlugin = (NDPluginBar *) drvPvt;
+    pPlugin->driverCallback(pasynUser, genericPointer);
+}
+
+/**
+ * Override of NDPluginDriver function. Connects each source to the NDArrayPort and NDArrayAddr
+ * set at its asyn address. Sources with an empty port name are left unconnected.
+ *
+ * @return: status of subscribing to the connected sources
+ */
+asynStatus NDPluginBar::connectToArrayPort(void) {
+    static const char *functionName = "connectToArrayPort";
+    asynStatus status;
+    asynInterface *pasynInterface;
+    int enableCallbacks, arrayAddr, i;
+    char arrayPort[256];
+
+    getIntegerParam(NDPluginDriverEnableCallbacks, &enableCallbacks);
+    // stop callbacks from every source before changing any connection
+    setArrayInterrupt(0);
+    for (i = 0; i < numSources; i++) {
+        NDBarSource &src = sources[i];
+        if (src.connected) {
+            pasynManager->disconnect(src.pasynUserGenericPointer);
+            src.connected = false;
+        }
+        arrayPort[0] = '\0';
+        getStringParam(i, NDPluginDriverArrayPort, sizeof(arrayPort), arrayPort);
+        getIntegerParam(i, NDPluginDriverArrayAddr, &arrayAddr);
+        if (strlen(arrayPort) == 0) continue;
+
+        status = pasynManager->connectDevice(src.pasynUserGenericPointer, arrayPort, arrayAddr);
+        if (status != asynSuccess) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s::%s Error connecting source %d to array port %s address %d\n",
+                      driverName, functionName, i, arrayPort, arrayAddr);
+            continue;
+        }
+        pasynInterface =
+            pasynManager->findInterface(src.pasynUserGenericPointer, asynGenericPointerType, 1);
+        if (!pasynInterface) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s::%s Error, array port %s of source %d has no asynGenericPointer\n",
+                      driverName, functionName, arrayPort, i);
+            pasynManager->disconnect(src.pasynUserGenericPointer);
+            continue;
+        }
+        src.pasynGenericPointer = (asynGenericPointer *) pasynInterface->pinterface;
+        src.asynGenericPointerPvt = pasynInterface->drvPvt;
+        src.connected = true;
+    }
+    return setArrayInterrupt(enableCallbacks);
+}
+
+/**
+ * Override of NDPluginDriver function. Registers for, or cancels, NDArray callbacks from
+ * every connected source. Must be called with the lock held.
+ *
+ * @params[in]: enableCallbacks -> 1 to receive arrays, 0 to stop receiving them
+ * @return: error if any source could not be changed, otherwise success
+ */
+asynStatus NDPluginBar::setArrayInterrupt(int enableCallbacks) {
+    static const char *functionName = "setArrayInterrupt";
+    asynStatus status = asynSuccess;
+    int i;
+
+    // no new array may arrive to trigger it, so release work the base class let go of now
+    if (!enableCallbacks) releaseDroppedWork();
+    for (i = 0; i < numSources; i++) {
+        NDBarSource &src = sources[i];
+        asynStatus s = asynSuccess;
+        if (enableCallbacks && src.connected && src.asynGenericPointerInterruptPvt == NULL) {
+            s = src.pasynGenericPointer->registerInterruptUser(
+                src.asynGenericPointerPvt, src.pasynUserGenericPointer, barDriverCallback, this,
+                &src.asynGenericPointerInterruptPvt);
+        } else if (!enableCallbacks && src.asynGenericPointerInterruptPvt != NULL) {
+            s = src.pasynGenericPointer->cancelInterruptUser(src.asynGenericPointerPvt,
+                                                             src.pasynUserGenericPointer,
+                                                             src.asynGenericPointerInterruptPvt);
+            src.asynGenericPointerInterruptPvt = NULL;
+        }
+        if (s != asynSuccess) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s::%s Error changing array callbacks of source %d\n", driverName,
+                      functionName, i);
+            status = s;
+        }
+    }
+    return status;
+}
+
+/**
+ * Function that counts an array dropped from a source, and publishes the count
+ */
+void NDPluginBar::countSourceDrop(int source) {
+    sources[source].dropped++;
+    setIntegerParam(source, NDPluginBarSourceDropped, sources[source].dropped);
+    callParamCallbacks(source);
+}
+
+/**
+ * Function that releases the arrays of work items whose token the base class let go of without
+ * calling processCallbacks, so that no camera array stays referenced by a work item that will
+ * never run. Called when a new array arrives, and when callbacks are disabled or the sources
+ * reconnected. Must be called with the lock held.
+ */
+void NDPluginBar::releaseDroppedWork() {
+    int i;
+    for (i = 0; i < numWorkItems; i++) {
+        NDBarWorkItem &item = workItems[i];
+        if (item.pArray == NULL || item.sending || item.token->getReferenceCount() > 1) continue;
+        item.pArray->release();
+        item.pArray = NULL;
+        sources[item.source].queued--;
+        countSourceDrop(item.source);
+    }
+}
+
+/**
+ * Function that finds a work item whose token is not referenced by the base class.
+ * Must be called with the lock held.
+ *
+ * @return: index of the work item, or -1 if all are in use
+ */
+int NDPluginBar::findFreeWorkItem() {
+    int i;
+    for (i = 0; i < numWorkItems; i++) {
+        const NDBarWorkItem &item = workItems[i];
+        // a work item being handed over stays taken until driverCallback has checked it
+        if (item.token == NULL || item.pArray != NULL || item.sending) continue;
+        if (item.token->getReferenceCount() == 1) return i;
+    }
+    return -1;
+}
+
+/**
+ * Override of NDPluginDriver function, called when any source produces an array. The array is
+ * attached to a free work item, and the token of the work item is handed to the base class,
+ * which applies MinCallbackTime and its queue limit, and queues it for the shared worker
+ * threads. The worker that picks the token up decodes the array attached to it, so no frame
+ * depends on the order in which workers reach the lock. The reference count of the token
+ * shows whether the base class queued it: if it did not, the array is released at once and
+ * counted as dropped. With several sources, a source that already has its share of the queue
+ * waiting has the new array dropped, so that a busy camera cannot fill the queue and starve
+ * the others.
+ *
+ * @params[in]: pasynUser      -> asyn user of the source the array came from
+ * @params[in]: genericPointer -> the NDArray
+ */
+void NDPluginBar::driverCallback(asynUser *pasynUser, void *genericPointer) {
+    NDArray *pArray = (NDArray *) genericPointer;
+    int enableCallbacks, source, i;
+
+    this->lock();
+    getIntegerParam(NDPluginDriverEnableCallbacks, &enableCallbacks);
+    for (source = 0; source < numSources; source++) {
+        if (sources[source].pasynUserGenericPointer == pasynUser) break;
+    }
+    if (!enableCallbacks || source == numSources) {
+        this->unlock();
+        return;
+    }
+    releaseDroppedWork();
+    i = findFreeWorkItem();
+    if (i < 0 || (numSources > 1 && sources[source].queued >= sourceShare)) {
+        countSourceDrop(source);
+        this->unlock();
+        return;
+    }
+    NDBarWorkItem &item = workItems[i];
+    pArray->reserve();
+    item.pArray = pArray;
+    item.source = source;
+    item.sending = true;
+    sources[source].queued++;
+    NDArray *token = item.token;
+    this->unlock();
+
+    NDPluginDriver::driverCallback(pasynUser, token);
+
+    this->lock();
+    item.sending = false;
+    // still attached and only referenced here, so the base class did not queue the token
+    if (item.pArray != NULL && token->getReferenceCount() == 1) {
+        item.pArray->release();
+        item.pArray = NULL;
+        sources[source].queued--;
+        countSourceDrop(source);
+    }
+    this->unlock();
+}
+
+//------------------------------------------------------
+// Sample manifest functions
+//------------------------------------------------------
+
+/**
+ * Function that loads the manifest named by the ManifestFile PV, and swaps it in for the one
+ * in use. Must be called with the lock held. The file is read with the lock released, so
+ * frames keep being decoded with the previous manifest meanwhile. If loading fails the
+ * previous manifest is kept, and an empty file name unloads the manifest.
+ *
+ * @return: error if the file could not be loaded, otherwise success
+ */
+asynStatus NDPluginBar::reloadManifest() {
+    const char *functionName = "reloadManifest";
+    char fileName[256] = "";
+    string message;
+    NDBarManifest *pLoaded = NULL;
+
+    getStringParam(NDPluginBarManifestFile, sizeof(fileName), fileName);
+    if (strlen(fileName) > 0) {
+        this->unlock();
+        pLoaded = NDBarManifest::load(fileName, message);
+        this->lock();
+    } else {
+        message = "No manifest loaded";
+    }
+
+    asynStatus status = asynSuccess;
+    if (pLoaded != NULL || strlen(fileName) == 0) {
+        manifest.reset(pLoaded);
+    } else {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s Error loading manifest: %s\n",
+                  driverName, functionName, message.c_str());
+        status = asynError;
+    }
+    setIntegerParam(NDPluginBarManifestRows, manifest ? manifest->rows() : 0);
+    setStringParam(NDPluginBarManifestStatus, message.c_str());
+    return status;
+}
+
+//------------------------------------------------------
+// Shared memory export functions
+//------------------------------------------------------
+
+/**
+ * Function that opens or closes the shared memory region to match the ShmEnable and ShmName
+ * PVs. Must be called with the lock held, so no frame is exported while the region changes.
+ * The region is only unmapped when closed, and stays available to readers until removed.
+ *
+ * @return: error if the region could not be opened, otherwise success
+ */
+asynStatus NDPluginBar::updateSharedMemory() {
+    const char *functionName = "updateSharedMemory";
+    char name[256] = "";
+    int enable;
+    string message = "Disabled";
+    asynStatus status = asynSuccess;
+
+    getIntegerParam(NDPluginBarShmEnable, &enable);
+    getStringParam(NDPluginBarShmName, sizeof(name), name);
+    shmExport->close();
+    if (enable == 1 && shmExport->open(name, message) != 0) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s::%s Error opening shared memory: %s\n", driverName, functionName,
+                  message.c_str());
+        setIntegerParam(NDPluginBarShmEnable, 0);
+        status = asynError;
+    }
+    setStringParam(NDPluginBarShmStatus, message.c_str());
+    return status;
+}
+
+/**
+ * Override of NDPluginDriver function. Loads the sample manifest when its file name is set,
+ * which also covers the value restored at startup, and reopens the shared memory export
+ * when its name changes.
+ *
+ * @params[in]: pasynUser	-> pointer to asyn User that initiated the transaction
+ * @params[in]: value		-> string the PV was set to
+ * @params[in]: nChars		-> number of characters in value
+ * @params[out]: nActual	-> number of characters written
+ * @return: success if PV was updated correctly, otherwise error
+ */
+asynStatus NDPluginBar::writeOctet(asynUser *pasynUser, const char *value, size_t nChars,
+                                   size_t *nActual) {
+    int function = pasynUser->reason;
+    asynStatus status;
+
+    if (function != NDPluginBarManifestFile && function != NDPluginBarShmName)
+        return NDPluginDriver::writeOctet(pasynUser, value, nChars, nActual);
+
+    setStringParam(function, value);
+    *nActual = nChars;
+    if (function == NDPluginBarManifestFile)
+        status = reloadManifest();
+    else
+        status = updateSharedMemory();
+    callParamCallbacks();
+    return status;
+}
+
 /**
  * Override of NDPluginDriver function. Used when selecting between barcodes
- * for which corners should be shown.
+ * for which corners should be shown, and to restart auto-tune when the decoder
+ * settings change. All plugin parameters are kept per source, at the asyn address
+ * of the source.
  *
  * @params[in]: pasynUser	-> pointer to asyn User that initiated the transaction
  * @params[in]: value		-> value PV was set to
@@ -449,28 +975,42 @@ asynStatus NDPluginBar::writeInt32(asynUser *pasynUser, epicsInt32 value) {
     const char *functionName = "writeInt32";
     int function = pasynUser->reason;
     asynStatus status = asynSuccess;
+    int addr;
 
-    status = setIntegerParam(function, value);
-    asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER, "%s::%s function = %d value=%d\n",
-              driverName, functionName, function, value);
+    getAddress(pasynUser, &addr);
+    status = setIntegerParam(addr, function, value);
+    asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER, "%s::%s function = %d addr=%d value=%d\n",
+              driverName, functionName, function, addr, value);
 
+    NDBarSource &src = sources[addr];
     if (function == NDPluginBarCodeCorners) {
         int i;
-        if (codes_in_image.size() <= (size_t) value) {
+        if (value < 0 || src.num_codes_in_image <= value) {
             for (i = 0; i < 4; i++) {
-                setIntegerParam(cornerXPVs[i], 0);
-                setIntegerParam(cornerYPVs[i], 0);
+                setIntegerParam(addr, cornerXPVs[i], 0);
+                setIntegerParam(addr, cornerYPVs[i], 0);
             }
         } else {
-            for (i = 0; i < 4; i++) {
-                setIntegerParam(cornerXPVs[i], codes_in_image[value].position[i].x);
-                setIntegerParam(cornerYPVs[i], codes_in_image[value].position[i].y);
-            }
+            updateCorners(addr, src.codes_in_image[value], src.codes_image_height);
         }
+    } else if (function == NDPluginBarAutoTune || function == NDPluginBarScanDensity ||
+               function == NDPluginBarScaleFactor) {
+        resetAutoTune(addr);
+    } else if (function == NDPluginBarExpectedCodes) {
+        src.coarse_skip = 0;
+    } else if (function == NDPluginBarSourceDropped) {
+        src.dropped = value;
+    } else if (function == NDPluginBarManifestReload) {
+        if (value == 1) status = reloadManifest();
+        setIntegerParam(NDPluginBarManifestReload, 0);
+    } else if (function == NDPluginBarShmEnable) {
+        status = updateSharedMemory();
     } else if (function < ND_BAR_FIRST_PARAM) {
         status = NDPluginDriver::writeInt32(pasynUser, value);
+        // the base class only tracks its own connection, so apply the change to all sources
+        if (function == NDPluginDriverEnableCallbacks) setArrayInterrupt(value);
     }
-    callParamCallbacks();
+    callParamCallbacks(addr);
     if (status) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s Error writing Int32 val to PV\n",
                   driverName, functionName);
@@ -478,18 +1018,56 @@ asynStatus NDPluginBar::writeInt32(asynUser *pasynUser, epicsInt32 value) {
     return status;
 }
 
-/* Process callbacks function inherited from NDPluginDriver.
- * Here it is overridden, and the following steps are taken:
- * 1) Check if the NDArray is mono, as zbar only accepts mono/grayscale images
- * 2) Convert the NDArray recieved into an OpenCV Mat object
- * 3) Decode barcode method is called
- * 4) (Currently Disabled) Show barcode method is called
+/* Process callbacks function inherited from NDPluginDriver. The array passed in is the token
+ * of a work item; the camera array attached to it is decoded with the settings, and published
+ * to the PVs, of the source it came from.
  *
- * @params[in]: pArray -> NDArray recieved by the plugin from the camera
+ * @params[in]: pArray -> token of the work item queued by the base class
  * @return: void
  */
 void NDPluginBar::processCallbacks(NDArray *pArray) {
     static const char *functionName = "processCallbacks";
+    int i;
+    for (i = 0; i < numWorkItems; i++) {
+        if (workItems[i].token == pArray) break;
+    }
+    if (i == numWorkItems || workItems[i].pArray == NULL) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                  "%s::%s Error, array was not received from a source\n", driverName,
+                  functionName);
+        return;
+    }
+    NDBarWorkItem &item = workItems[i];
+    NDArray *pSourceArray = item.pArray;
+    int source = item.source;
+    item.pArray = NULL;
+    sources[source].queued--;
+    process_source_array(pSourceArray, source);
+    pSourceArray->release();
+}
+
+/* Function that decodes a single frame from a source. Called with the lock held.
+ * The following steps are taken:
+ * 1) Convert the NDArray recieved into an OpenCV Mat object, in grayscale as zbar requires
+ * 2) Decode barcode method is called, with the lock released
+ * 3) Show barcode method draws the codes into the output NDArray
+ * 4) With the lock held again, the decoded codes are pushed to the PVs of the source
+ *
+ * Working storage comes from per thread scratch that is sized on the first frame. When built
+ * with BAR_COUNT_ALLOCATIONS, the heap allocations made by this thread while processing the
+ * frame, including those made inside OpenCV and zbar, are counted and published to the
+ * FrameAllocations PV.
+ *
+ * @params[in]: pArray -> NDArray recieved by the plugin from the camera
+ * @params[in]: source -> source the array came from
+ * @return: void
+ */
+void NDPluginBar::process_source_array(NDArray *pArray, int source) {
+    static const char *functionName = "process_source_array";
+
+    // per thread scratch storage, constructed on the first frame seen by each thread. Being
+    // thread local, its kept output arrays start out NULL
+    static thread_local NDBarScratch scratch;
 
     Mat img;
     NDArrayInfo arrayInfo;
@@ -497,15 +1075,31 @@ void NDPluginBar::processCallbacks(NDArray *pArray) {
     NDDataType_t dataType = NDUInt8;
     // output will always be in 3 channel RGB mode
     NDColorMode_t colorMode = NDColorModeRGB1;
-    int ndims = 3;
-    size_t dims[ndims];
+    size_t dims[3];
+    bar_decode_options options;
+    double time_budget;
+
+#ifdef BAR_COUNT_ALLOCATIONS
+    unsigned long startAllocations = barThreadAllocations();
+#endif
 
     // call base class and get information about frame
     NDPluginDriver::beginProcessCallbacks(pArray);
+    getIntegerParam(source, NDPluginBarInvertedBarcode, &options.inverted);
+    getIntegerParam(source, NDPluginBarExpectedCodes, &options.expected_codes);
+    getDoubleParam(source, NDPluginBarTimeBudget, &time_budget);
+    options.time_budget = time_budget / 1000.0;
+    getIntegerParam(source, NDPluginBarActiveScanDensity, &options.density);
+    getIntegerParam(source, NDPluginBarActiveScaleFactor, &options.scale);
+    getIntegerParam(source, NDPluginBarRotatedCodes, &options.rotated);
+    // coarse passes only add to the cost while the source keeps needing the full pass
+    options.coarse_passes = sources[source].coarse_skip > 0 ? 0 : 1;
+    // take a reference, so a reload while decoding does not free the manifest in use
+    scratch.manifest = manifest;
 
     // convert to Mat
     pArray->getInfo(&arrayInfo);
-    asynStatus status = ndArray2Mat(pArray, &arrayInfo, img);
+    asynStatus status = ndArray2Mat(pArray, &arrayInfo, img, scratch);
     if (status == asynError) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s Error converting to Mat\n",
                   driverName, functionName);
@@ -525,55 +1119,69 @@ void NDPluginBar::processCallbacks(NDArray *pArray) {
     else if (img.depth() == CV_16S)
         dataType = NDInt16;
 
-    pScratch = pNDArrayPool->alloc(ndims, dims, dataType, 0, NULL);
+    // reuses a kept output array when one is free, so its attributes are updated in place
+    pScratch = takeOutputArray(scratch, dims, dataType);
     if (pScratch == NULL) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s Error, unable to allocate array\n",
                   driverName, functionName);
-        img.release();
         return;
     }
 
     // unlock the mutex for the processing portion
     this->unlock();
 
-    // if(!this->processing){
-    //     asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s::%s Starting processing thread\n",
-    //     driverName, functionName); this->processing = true; thread
-    //     processing_thread(barcode_image_callback_wrapper, this, pArray);
-    //     processing_thread.detach();
-    // }
-
     // process the image
-    status = barcode_image_callback(img, pScratch);
+    status = barcode_image_callback(img, options, pScratch, scratch);
+
+    this->lock();
+
     if (status != asynSuccess) {
         pScratch->release();
-        img.release();
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s Error processing image\n",
                   driverName, functionName);
         return;
     }
 
-    this->lock();
-
-    // push the image out using endProcess callbacks
+    publish_bar_codes(source, scratch, matSize.height);
+    export_bar_codes(source, pArray, scratch, matSize);
+    update_auto_tune(source, scratch, options.expected_codes);
+    if (scratch.coarse_missed)
+        sources[source].coarse_skip = COARSE_SKIP_FRAMES;
+    else if (sources[source].coarse_skip > 0)
+        sources[source].coarse_skip--;
+    setIntegerParam(source, NDPluginBarPartialFrame, scratch.partial ? 1 : 0);
+    setDoubleParam(source, NDPluginBarDecodeTime, scratch.decode_time);
+    setIntegerParam(source, NDPluginBarRotatedRegions, scratch.rotated_regions);
+    scratch.manifest.reset();
+
+    // push the image out using endProcess callbacks, tagged with the source it came from.
+    // The attributes already exist on a reused array, so adding them only sets their values
     pScratch->uniqueId = pArray->uniqueId;
     pScratch->pAttributeList->add("ColorMode", "Color Mode", NDAttrInt32, &colorMode);
+    pScratch->pAttributeList->add("BarSource", "Barcode input source", NDAttrInt32, &source);
+#ifdef BAR_COUNT_ALLOCATIONS
+    // downstream plugins may run on this thread, so stop counting before passing the array on
+    setIntegerParam(source, NDPluginBarFrameAllocations,
+                    (int) (barThreadAllocations() - startAllocations));
+#endif
     endProcessCallbacks(pScratch, false, true);
 
+    if (source != 0) callParamCallbacks(source);
     callParamCallbacks();
 }
 
 // constructror from base class
 NDPluginBar::NDPluginBar(const char *portName, int queueSize, int blockingCallbacks,
                          const char *NDArrayPort, int NDArrayAddr, int maxBuffers, size_t maxMemory,
-                         int priority, int stackSize, int maxThreads)
-    /* Invoke the base class constructor */
-    : NDPluginDriver(portName, queueSize, blockingCallbacks, NDArrayPort, NDArrayAddr, 1,
-                     maxBuffers, maxMemory,
+                         int priority, int stackSize, int maxThreads, int maxSources)
+    /* Invoke the base class constructor, with one asyn address per source */
+    : NDPluginDriver(portName, queueSize, blockingCallbacks, NDArrayPort, NDArrayAddr,
+                     maxSources > 1 ? maxSources : 1, maxBuffers, maxMemory,
                      asynInt32ArrayMask | asynFloat64ArrayMask | asynGenericPointerMask,
-                     asynInt32ArrayMask | asynFloat64ArrayMask | asynGenericPointerMask, 0, 1,
-                     priority, stackSize, maxThreads) {
+                     asynInt32ArrayMask | asynFloat64ArrayMask | asynGenericPointerMask,
+                     maxSources > 1 ? ASYN_MULTIDEVICE : 0, 1, priority, stackSize, maxThreads) {
     char versionString[25];
+    int i;
 
     // basic barcode parameters 1-5
     createParam(NDPluginBarBarcodeMessage1String, asynParamOctet, &NDPluginBarBarcodeMessage1);
@@ -604,8 +1212,118 @@ NDPluginBar::NDPluginBar(const char *portName, int queueSize, int blockingCallba
     createParam(NDPluginBarLowerLeftYString, asynParamInt32, &NDPluginBarLowerLeftY);
     createParam(NDPluginBarLowerRightYString, asynParamInt32, &NDPluginBarLowerRightY);
 
+    // debug counter of heap allocations made while processing the last frame
+    createParam(NDPluginBarFrameAllocationsString, asynParamInt32, &NDPluginBarFrameAllocations);
+
+    // early exit and time budget for decoding each frame
+    createParam(NDPluginBarExpectedCodesString, asynParamInt32, &NDPluginBarExpectedCodes);
+    createParam(NDPluginBarTimeBudgetString, asynParamFloat64, &NDPluginBarTimeBudget);
+    createParam(NDPluginBarPartialFrameString, asynParamInt32, &NDPluginBarPartialFrame);
+    createParam(NDPluginBarDecodeTimeString, asynParamFloat64, &NDPluginBarDecodeTime);
+
+    // decoder settings and auto-tune
+    createParam(NDPluginBarScanDensityString, asynParamInt32, &NDPluginBarScanDensity);
+    createParam(NDPluginBarScaleFactorString, asynParamInt32, &NDPluginBarScaleFactor);
+    createParam(NDPluginBarAutoTuneString, asynParamInt32, &NDPluginBarAutoTune);
+    createParam(NDPluginBarAutoTuneTargetString, asynParamFloat64, &NDPluginBarAutoTuneTarget);
+    createParam(NDPluginBarAutoTuneWindowString, asynParamInt32, &NDPluginBarAutoTuneWindow);
+    createParam(NDPluginBarAutoTuneLevelString, asynParamInt32, &NDPluginBarAutoTuneLevel);
+    createParam(NDPluginBarAutoTuneHitRateString, asynParamFloat64, &NDPluginBarAutoTuneHitRate);
+    createParam(NDPluginBarAutoTuneDecodeTimeString, asynParamFloat64,
+                &NDPluginBarAutoTuneDecodeTime);
+    createParam(NDPluginBarActiveScanDensityString, asynParamInt32,
+                &NDPluginBarActiveScanDensity);
+    createParam(NDPluginBarActiveScaleFactorString, asynParamInt32,
+                &NDPluginBarActiveScaleFactor);
+
+    // frames dropped from each source
+    createParam(NDPluginBarSourceDroppedString, asynParamInt32, &NDPluginBarSourceDropped);
+
+    // search for rotated 1D codes
+    createParam(NDPluginBarRotatedCodesString, asynParamInt32, &NDPluginBarRotatedCodes);
+    createParam(NDPluginBarRotatedRegionsString, asynParamInt32, &NDPluginBarRotatedRegions);
+
+    // sample manifest lookup
+    createParam(NDPluginBarManifestFileString, asynParamOctet, &NDPluginBarManifestFile);
+    createParam(NDPluginBarManifestReloadString, asynParamInt32, &NDPluginBarManifestReload);
+    createParam(NDPluginBarManifestRowsString, asynParamInt32, &NDPluginBarManifestRows);
+    createParam(NDPluginBarManifestStatusString, asynParamOctet, &NDPluginBarManifestStatus);
+    createParam(NDPluginBarSampleRow1String, asynParamInt32, &NDPluginBarSampleRow1);
+    createParam(NDPluginBarSampleKnown1String, asynParamInt32, &NDPluginBarSampleKnown1);
+    createParam(NDPluginBarSampleRow2String, asynParamInt32, &NDPluginBarSampleRow2);
+    createParam(NDPluginBarSampleKnown2String, asynParamInt32, &NDPluginBarSampleKnown2);
+    createParam(NDPluginBarSampleRow3String, asynParamInt32, &NDPluginBarSampleRow3);
+    createParam(NDPluginBarSampleKnown3String, asynParamInt32, &NDPluginBarSampleKnown3);
+    createParam(NDPluginBarSampleRow4String, asynParamInt32, &NDPluginBarSampleRow4);
+    createParam(NDPluginBarSampleKnown4String, asynParamInt32, &NDPluginBarSampleKnown4);
+    createParam(NDPluginBarSampleRow5String, asynParamInt32, &NDPluginBarSampleRow5);
+    createParam(NDPluginBarSampleKnown5String, asynParamInt32, &NDPluginBarSampleKnown5);
+    createParam(NDPluginBarSampleMismatchString, asynParamInt32, &NDPluginBarSampleMismatch);
+    setStringParam(NDPluginBarManifestFile, "");
+    setIntegerParam(NDPluginBarManifestReload, 0);
+    setIntegerParam(NDPluginBarManifestRows, 0);
+    setStringParam(NDPluginBarManifestStatus, "No manifest loaded");
+
+    // shared memory export, named after the port by default
+    char shmName[256];
+    createParam(NDPluginBarShmEnableString, asynParamInt32, &NDPluginBarShmEnable);
+    createParam(NDPluginBarShmNameString, asynParamOctet, &NDPluginBarShmName);
+    createParam(NDPluginBarShmStatusString, asynParamOctet, &NDPluginBarShmStatus);
+    // the template replaces this with a name that includes the record prefix
+    epicsSnprintf(shmName, sizeof(shmName), "/NDBar_%s", portName);
+    setIntegerParam(NDPluginBarShmEnable, 0);
+    setStringParam(NDPluginBarShmName, shmName);
+    setStringParam(NDPluginBarShmStatus, "Disabled");
+    shmExport = new NDBarShmExport();
+
     initPVArrays();
 
+    // set up the input sources, each with an equal share of the frame queue
+    numSources = maxSources > 1 ? maxSources : 1;
+    sourceShare = queueSize / numSources > 1 ? queueSize / numSources : 1;
+    // work items for every token the base class can have queued or being processed, and one
+    // per source being handed over, each with a one element token array from the pool
+    size_t tokenDims[1] = {1};
+    numWorkItems = (queueSize > 1 ? queueSize : 1) + (maxThreads > 1 ? maxThreads : 1);
+    numWorkItems += numSources;
+    workItems = new NDBarWorkItem[numWorkItems]();
+    for (i = 0; i < numWorkItems; i++) {
+        workItems[i].token = pNDArrayPool->alloc(1, tokenDims, NDInt8, 0, NULL);
+    }
+    sources = new NDBarSource[numSources]();
+    for (i = 0; i < numSources; i++) {
+        sources[i].pasynUserGenericPointer = pasynManager->createAsynUser(0, 0);
+        sources[i].pasynUserGenericPointer->reason = NDArrayData;
+        sources[i].pasynUserGenericPointer->userPvt = this;
+        if (i > 0) {
+            setStringParam(i, NDPluginDriverArrayPort, "");
+            setIntegerParam(i, NDPluginDriverArrayAddr, 0);
+        }
+
+        // stays -1 unless allocation counting is built in
+        setIntegerParam(i, NDPluginBarFrameAllocations, -1);
+        setIntegerParam(i, NDPluginBarExpectedCodes, 0);
+        setDoubleParam(i, NDPluginBarTimeBudget, 0.0);
+        setIntegerParam(i, NDPluginBarPartialFrame, 0);
+        setIntegerParam(i, NDPluginBarScanDensity, 1);
+        setIntegerParam(i, NDPluginBarScaleFactor, 1);
+        setIntegerParam(i, NDPluginBarAutoTune, 0);
+        setDoubleParam(i, NDPluginBarAutoTuneTarget, 95.0);
+        setIntegerParam(i, NDPluginBarAutoTuneWindow, 50);
+        setDoubleParam(i, NDPluginBarAutoTuneHitRate, 0.0);
+        setDoubleParam(i, NDPluginBarAutoTuneDecodeTime, 0.0);
+        setIntegerParam(i, NDPluginBarSourceDropped, 0);
+        setIntegerParam(i, NDPluginBarRotatedCodes, 0);
+        setIntegerParam(i, NDPluginBarRotatedRegions, 0);
+        for (int j = 0; j < NUM_CODES; j++) {
+            setIntegerParam(i, sampleRowPVs[j], -1);
+            setIntegerParam(i, sampleKnownPVs[j], 0);
+        }
+        setIntegerParam(i, NDPluginBarSampleMismatch, 0);
+        clearPreviousCodes(i);
+        resetAutoTune(i);
+    }
+
     setStringParam(NDPluginDriverPluginType, "NDPluginBar");
     epicsSnprintf(versionString, sizeof(versionString), "%d.%d.%d", BAR_VERSION, BAR_REVISION,
                   BAR_MODIFICATION);
@@ -615,16 +1333,19 @@ NDPluginBar::NDPluginBar(const char *portName, int queueSize, int blockingCallba
 
 /**
  * External configure function. This will be called from the IOC shell of the
- * detector the plugin is attached to, and will create an instance of the plugin and start it
+ * detector the plugin is attached to, and will create an instance of the plugin and start it.
+ * With maxSources > 1 the instance decodes arrays from that many sources, one per asyn address,
+ * sharing its maxThreads worker threads between them.
  *
  * @params[in]	-> all passed to constructor
  */
 extern "C" int NDBarConfigure(const char *portName, int queueSize, int blockingCallbacks,
                               const char *NDArrayPort, int NDArrayAddr, int maxBuffers,
-                              size_t maxMemory, int priority, int stackSize, int maxThreads) {
+                              size_t maxMemory, int priority, int stackSize, int maxThreads,
+                              int maxSources) {
     NDPluginBar *pPlugin =
         new NDPluginBar(portName, queueSize, blockingCallbacks, NDArrayPort, NDArrayAddr,
-                        maxBuffers, maxMemory, priority, stackSize, maxThreads);
+                        maxBuffers, maxMemory, priority, stackSize, maxThreads, maxSources);
     return pPlugin->start();
 }
 
@@ -639,16 +1360,19 @@ static const iocshArg initArg6 = {"maxMemory", iocshArgInt};
 static const iocshArg initArg7 = {"priority", iocshArgInt};
 static const iocshArg initArg8 = {"stackSize", iocshArgInt};
 static const iocshArg initArg9 = {"maxThreads", iocshArgInt};
-static const iocshArg *const initArgs[] = {&initArg0, &initArg1, &initArg2, &initArg3, &initArg4,
-                                           &initArg5, &initArg6, &initArg7, &initArg8, &initArg9};
+static const iocshArg initArg10 = {"maxSources", iocshArgInt};
+static const iocshArg *const initArgs[] = {&initArg0, &initArg1, &initArg2, &initArg3,
+                                           &initArg4, &initArg5, &initArg6, &initArg7,
+                                           &initArg8, &initArg9, &initArg10};
 
 /* Definition of the configure function for NDPluginBar in the IOC shell */
-static const iocshFuncDef initFuncDef = {"NDBarConfigure", 10, initArgs};
+static const iocshFuncDef initFuncDef = {"NDBarConfigure", 11, initArgs};
 
 /* link the configure function with the passed args, and call it from the IOC shell */
 static void initCallFunc(const iocshArgBuf *args) {
     NDBarConfigure(args[0].sval, args[1].ival, args[2].ival, args[3].sval, args[4].ival,
-                   args[5].ival, args[6].ival, args[7].ival, args[8].ival, args[9].ival);
+                   args[5].ival, args[6].ival, args[7].ival, args[8].ival, args[9].ival,
+                   args[10].ival);
 }
 
 /* function to register the configure function in the IOC shell */
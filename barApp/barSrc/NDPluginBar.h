@@ -15,6 +15,7 @@
 // two includes
 #include <zbar.h>
 
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <thread>
 
@@ -25,6 +26,15 @@ using namespace zbar;
 // include base plugin driver
 #include "NDPluginDriver.h"
 
+// decoding pipeline shared with the offline batch decoder
+#include "NDBarDecoder.h"
+
+// sample manifest lookup
+#include "NDBarManifest.h"
+
+// shared memory export of results, kept out of this header as it maps OS specific memory
+class NDBarShmExport;
+
 // version numbers
 #define BAR_VERSION 2
 #define BAR_REVISION 2
@@ -33,6 +43,9 @@ using namespace zbar;
 // Number of barcodes supported at one time
 #define NUM_CODES 5
 
+// Number of recent output arrays each thread keeps for reuse
+#define NUM_OUTPUT_ARRAYS 2
+
 /* Here I will define all of the output data types once the database is written */
 #define NDPluginBarBarcodeMessage1String "BARCODE_MESSAGE1"  // asynOctet
 #define NDPluginBarBarcodeType1String "BARCODE_TYPE1"        // asynOctet
@@ -55,29 +68,138 @@ using namespace zbar;
 #define NDPluginBarUpperRightYString "UPPER_RIGHT_Y"         // asynInt32
 #define NDPluginBarLowerLeftYString "LOWER_LEFT_Y"           // asynInt32
 #define NDPluginBarLowerRightYString "LOWER_RIGHT_Y"         // asynInt32
-
-/* structure that contains information about the bar/QR code */
+#define NDPluginBarFrameAllocationsString "FRAME_ALLOCATIONS" // asynInt32
+#define NDPluginBarExpectedCodesString "EXPECTED_CODES"      // asynInt32
+#define NDPluginBarTimeBudgetString "TIME_BUDGET"            // asynFloat64
+#define NDPluginBarPartialFrameString "PARTIAL_FRAME"        // asynInt32
+#define NDPluginBarDecodeTimeString "DECODE_TIME"            // asynFloat64
+#define NDPluginBarScanDensityString "SCAN_DENSITY"          // asynInt32
+#define NDPluginBarScaleFactorString "SCALE_FACTOR"          // asynInt32
+#define NDPluginBarAutoTuneString "AUTO_TUNE"                // asynInt32
+#define NDPluginBarAutoTuneTargetString "AUTO_TUNE_TARGET"   // asynFloat64
+#define NDPluginBarAutoTuneWindowString "AUTO_TUNE_WINDOW"   // asynInt32
+#define NDPluginBarAutoTuneLevelString "AUTO_TUNE_LEVEL"     // asynInt32
+#define NDPluginBarAutoTuneHitRateString "AUTO_TUNE_HIT_RATE"        // asynFloat64
+#define NDPluginBarAutoTuneDecodeTimeString "AUTO_TUNE_DECODE_TIME"  // asynFloat64
+#define NDPluginBarActiveScanDensityString "ACTIVE_SCAN_DENSITY"     // asynInt32
+#define NDPluginBarActiveScaleFactorString "ACTIVE_SCALE_FACTOR"     // asynInt32
+#define NDPluginBarSourceDroppedString "SOURCE_DROPPED"              // asynInt32
+#define NDPluginBarRotatedCodesString "ROTATED_CODES"                // asynInt32
+#define NDPluginBarRotatedRegionsString "ROTATED_REGIONS"            // asynInt32
+#define NDPluginBarManifestFileString "MANIFEST_FILE"                // asynOctet
+#define NDPluginBarManifestReloadString "MANIFEST_RELOAD"            // asynInt32
+#define NDPluginBarManifestRowsString "MANIFEST_ROWS"                // asynInt32
+#define NDPluginBarManifestStatusString "MANIFEST_STATUS"            // asynOctet
+#define NDPluginBarSampleRow1String "SAMPLE_ROW1"                    // asynInt32
+#define NDPluginBarSampleKnown1String "SAMPLE_KNOWN1"                // asynInt32
+#define NDPluginBarSampleRow2String "SAMPLE_ROW2"                    // asynInt32
+#define NDPluginBarSampleKnown2String "SAMPLE_KNOWN2"                // asynInt32
+#define NDPluginBarSampleRow3String "SAMPLE_ROW3"                    // asynInt32
+#define NDPluginBarSampleKnown3String "SAMPLE_KNOWN3"                // asynInt32
+#define NDPluginBarSampleRow4String "SAMPLE_ROW4"                    // asynInt32
+#define NDPluginBarSampleKnown4String "SAMPLE_KNOWN4"                // asynInt32
+#define NDPluginBarSampleRow5String "SAMPLE_ROW5"                    // asynInt32
+#define NDPluginBarSampleKnown5String "SAMPLE_KNOWN5"                // asynInt32
+#define NDPluginBarSampleMismatchString "SAMPLE_MISMATCH"            // asynInt32
+#define NDPluginBarShmEnableString "SHM_ENABLE"                      // asynInt32
+#define NDPluginBarShmNameString "SHM_NAME"                          // asynOctet
+#define NDPluginBarShmStatusString "SHM_STATUS"                      // asynOctet
+
+/* Per thread scratch storage used by processCallbacks. Sized on the first frame
+ * and only reallocated when the image dimensions change */
+typedef struct {
+    // decoder with its own zbar scanner and scratch image
+    NDBarDecoder decoder;
+    // grayscale conversion of RGB input
+    Mat gray;
+    // codes found in the current frame, num_found may exceed NUM_CODES
+    bar_QR_code codes[NUM_CODES];
+    int num_found;
+    // set if decoding was cut short by the time budget
+    bool partial;
+    // time spent decoding the current frame in ms
+    double decode_time;
+    // number of rotated regions warped and scanned in the current frame
+    int rotated_regions;
+    // set if coarse passes could not have found the expected codes in the current frame
+    bool coarse_missed;
+    // manifest in use for the current frame, and the manifest row of each code, -1 if unknown
+    std::shared_ptr<const NDBarManifest> manifest;
+    int sample_rows[NUM_CODES];
+    // recent output arrays, with a reference held on each, reused with their attributes once
+    // downstream plugins have released them
+    NDArray *outputs[NUM_OUTPUT_ARRAYS];
+} NDBarScratch;
+
+/* State kept for each input source, one per asyn address. Source 0 is connected to the
+ * NDArrayPort and NDArrayAddr passed to NDBarConfigure, the others through their own PVs */
 typedef struct {
-    string type;
-    string data;
-    vector<Point> position;
-    int id;
-} bar_QR_code;
+    // connection to the NDArray port of the source
+    asynUser *pasynUserGenericPointer;
+    asynGenericPointer *pasynGenericPointer;
+    void *asynGenericPointerPvt;
+    void *asynGenericPointerInterruptPvt;
+    bool connected;
+
+    // work items of this source queued by the base class and not yet being decoded
+    int queued;
+    // arrays dropped because the share of the source was full, or the base class did not
+    // queue them
+    int dropped;
+
+    // codes discovered in the last frame from this source, and the height of that frame
+    bar_QR_code codes_in_image[NUM_CODES];
+    int num_codes_in_image;
+    int codes_image_height;
+
+    // auto-tune state: current level, frames and hits in the current window, decode time
+    // summed over the window, and windows left before stepping cheaper after a back off
+    int tune_level;
+    int tune_frames;
+    int tune_hits;
+    double tune_time;
+    int tune_hold;
+
+    // frames left to decode without coarse passes, after a frame that needed the full pass
+    int coarse_skip;
+} NDBarSource;
+
+/* Work item handed to the base class for one array from a source. The base class queues a one
+ * element token array from the plugin pool rather than the camera array, so that the reference
+ * count of the token, which nothing else touches, shows whether the base class queued it.
+ * The worker that receives the token decodes the array attached to it */
+typedef struct {
+    NDArray *token;
+    // array to decode, with a reference held, NULL once taken for decoding or released
+    NDArray *pArray;
+    int source;
+    // set while the token is being handed to the base class, the work item cannot be reused
+    // until it is cleared
+    bool sending;
+} NDBarWorkItem;
 
 /* class that does barcode readings */
 class NDPluginBar : public NDPluginDriver {
    public:
     NDPluginBar(const char *portName, int queueSize, int blockingCallbacks, const char *NDArrayPort,
                 int NDArrayAddr, int maxBuffers, size_t maxMemory, int priority, int stackSize,
-                int maxThreads);
+                int maxThreads, int maxSources);
 
     //~NDPluginBar();
 
     void processCallbacks(NDArray *pArray);
-    asynStatus barcode_image_callback(Mat &img, NDArray *pArrayOut);
+    virtual void driverCallback(asynUser *pasynUser, void *genericPointer);
+    asynStatus barcode_image_callback(Mat &img, const bar_decode_options &options,
+                                      NDArray *pArrayOut, NDBarScratch &scratch);
     virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    virtual asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars,
+                                  size_t *nActual);
 
    protected:
+    // connect to and subscribe to the NDArray ports of all sources
+    virtual asynStatus connectToArrayPort(void);
+    virtual asynStatus setArrayInterrupt(int enableCallbacks);
+
     // in this section i define the coords of database vals
 
     // message contained in bar code and its type
@@ -129,7 +251,71 @@ class NDPluginBar : public NDPluginDriver {
     // lower right pixel of found bar code
     int NDPluginBarLowerRightY;
 
-#define ND_BAR_LAST_PARAM NDPluginBarLowerRightY
+    // heap allocations made while processing the last frame
+    int NDPluginBarFrameAllocations;
+
+    // number of codes expected per frame, scanning stops early once found
+    int NDPluginBarExpectedCodes;
+
+    // time allowed for decoding a frame in ms
+    int NDPluginBarTimeBudget;
+
+    // set when the last frame was cut short by the time budget
+    int NDPluginBarPartialFrame;
+
+    // time spent decoding the last frame in ms
+    int NDPluginBarDecodeTime;
+
+    // manual decoder settings, used when auto-tune is off
+    int NDPluginBarScanDensity;
+    int NDPluginBarScaleFactor;
+
+    // auto-tune enable, target hit rate in percent and window length in frames
+    int NDPluginBarAutoTune;
+    int NDPluginBarAutoTuneTarget;
+    int NDPluginBarAutoTuneWindow;
+
+    // auto-tune level, and hit rate and mean decode time over the last window
+    int NDPluginBarAutoTuneLevel;
+    int NDPluginBarAutoTuneHitRate;
+    int NDPluginBarAutoTuneDecodeTime;
+
+    // decoder settings currently in use
+    int NDPluginBarActiveScanDensity;
+    int NDPluginBarActiveScaleFactor;
+
+    // arrays dropped from a source because its queue was full
+    int NDPluginBarSourceDropped;
+
+    // search for rotated 1D codes, and number of regions warped in the last frame
+    int NDPluginBarRotatedCodes;
+    int NDPluginBarRotatedRegions;
+
+    // sample manifest file, reload trigger, and result of the last load
+    int NDPluginBarManifestFile;
+    int NDPluginBarManifestReload;
+    int NDPluginBarManifestRows;
+    int NDPluginBarManifestStatus;
+
+    // manifest row and known flag of each code, and alarm for codes missing from the manifest
+    int NDPluginBarSampleRow1;
+    int NDPluginBarSampleKnown1;
+    int NDPluginBarSampleRow2;
+    int NDPluginBarSampleKnown2;
+    int NDPluginBarSampleRow3;
+    int NDPluginBarSampleKnown3;
+    int NDPluginBarSampleRow4;
+    int NDPluginBarSampleKnown4;
+    int NDPluginBarSampleRow5;
+    int NDPluginBarSampleKnown5;
+    int NDPluginBarSampleMismatch;
+
+    // shared memory export of results, region name, and result of opening it
+    int NDPluginBarShmEnable;
+    int NDPluginBarShmName;
+    int NDPluginBarShmStatus;
+
+#define ND_BAR_LAST_PARAM NDPluginBarShmStatus
 
    private:
     // processing thread - unused
@@ -143,34 +329,63 @@ class NDPluginBar : public NDPluginDriver {
     int cornerXPVs[4];
     int cornerYPVs[4];
 
-    // vector that stores currently discovered barcodes
-    vector<bar_QR_code> codes_in_image;
-    asynStatus clearPreviousCodes();
-    int codePreviouslyFound(bar_QR_code barQR);
-    asynStatus clearUnusedBarcodePvs(int counter);
+    // arrays that hold indexes of PVs for manifest rows and known flags
+    int sampleRowPVs[NUM_CODES];
+    int sampleKnownPVs[NUM_CODES];
+
+    // loaded sample manifest. Replaced whole on reload, while frames being decoded keep
+    // their own reference to the manifest they started with
+    std::shared_ptr<const NDBarManifest> manifest;
+    asynStatus reloadManifest();
+
+    // shared memory region results are exported to, written by all sources under the lock
+    NDBarShmExport *shmExport;
+    asynStatus updateSharedMemory();
+    void export_bar_codes(int source, NDArray *pArray, NDBarScratch &scratch, Size imgSize);
+
+    // input sources. Each may have at most sourceShare arrays queued, so that a busy camera
+    // cannot starve the others
+    NDBarSource *sources;
+    int numSources;
+    int sourceShare;
+    void countSourceDrop(int source);
+
+    // work items, whose tokens are what the base class queues for the worker threads
+    NDBarWorkItem *workItems;
+    int numWorkItems;
+    int findFreeWorkItem();
+    void releaseDroppedWork();
+    void process_source_array(NDArray *pArray, int source);
+
+    asynStatus clearPreviousCodes(int source);
+    int codePreviouslyFound(int source, const bar_QR_code &barQR);
+    asynStatus clearUnusedBarcodePvs(int source, int counter);
 
     // functions called on plugin initialization
     asynStatus initPVArrays();
 
+    // functions that select decoder settings and step the auto-tune level
+    asynStatus applyDecodeSettings(int source);
+    asynStatus resetAutoTune(int source);
+    asynStatus update_auto_tune(int source, NDBarScratch &scratch, int expected);
+
     // image type conversion functions
     void printCVError(cv::Exception &e, const char *functionName);
-    asynStatus ndArray2Mat(NDArray *pArray, NDArrayInfo *arrayInfo, Mat &img);
-    asynStatus mat2NDArray(NDArray *pScratch, Mat &img);
+    asynStatus ndArray2Mat(NDArray *pArray, NDArrayInfo *arrayInfo, Mat &img,
+                           NDBarScratch &scratch);
+    asynStatus gray2NDArray(NDArray *pScratch, Mat &img, Mat &out);
+    NDArray *takeOutputArray(NDBarScratch &scratch, size_t *dims, NDDataType_t dataType);
 
     // Decoding functions
-    Image scan_image(Mat &img);
-    asynStatus decode_bar_codes(Mat &img);
+    asynStatus decode_bar_codes(Mat &img, const bar_decode_options &options,
+                                NDBarScratch &scratch);
+    asynStatus publish_bar_codes(int source, NDBarScratch &scratch, int imgHeight);
 
     // function that displays detected bar codes
-    asynStatus show_bar_codes(Mat &img);
-
-    // function that allows for reading inverted barcodes
-    asynStatus fix_inverted(Mat &img);
+    asynStatus show_bar_codes(Mat &img, NDBarScratch &scratch);
 
     // function that pushes barcode coordinate data to PVs
-    asynStatus push_corners(bar_QR_code &discovered, Image::SymbolIterator &symbol,
-                            int update_corners, int imgHeight);
-    asynStatus updateCorners(bar_QR_code &discovered, int imgHeight);
+    asynStatus updateCorners(int source, const bar_QR_code &discovered, int imgHeight);
 };
 
 #define NUM_BAR_PARAMS ((int) (&ND_BAR_LAST_PARAM - &ND_BAR_FIRST_PARAM + 1))
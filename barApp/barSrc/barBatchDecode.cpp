@@ -0,0 +1,35 @@
+/*
+ * barBatchDecode.cpp
+ *
+ * Standalone executable for decoding a recorded set of images offline,
+ * without starting an IOC. Uses the same pipeline as NDPluginBar.
+ *
+ * Usage: barBatchDecode <image dir | list file> <results.csv> [threads] [inverted] [density]
+ *                       [scale] [rotated]
+ *
+ * Created on: October 18, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "NDBarBatch.h"
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 8) {
+        fprintf(stderr,
+                "Usage: %s <image dir | list file> <results.csv> [threads] [inverted] [density] "
+                "[scale] [rotated]\n",
+                argv[0]);
+        return 1;
+    }
+    int numThreads = (argc > 3) ? atoi(argv[3]) : 0;
+    int inverted = (argc > 4) ? atoi(argv[4]) : 0;
+    int density = (argc > 5) ? atoi(argv[5]) : 1;
+    int scale = (argc > 6) ? atoi(argv[6]) : 1;
+    int rotated = (argc > 7) ? atoi(argv[7]) : 0;
+    // no IOC runs in this process, so HDF5 files can be read
+    int status =
+        NDBarBatchDecode(argv[1], argv[2], numThreads, inverted, density, scale, rotated, 1);
+    return status == 0 ? 0 : 1;
+}
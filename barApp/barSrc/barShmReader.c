@@ -0,0 +1,71 @@
+/*
+ * barShmReader.c
+ *
+ * Example reader for the shared memory export of NDPluginBar. Maps the region
+ * read only, and prints every new record as it is published. Frames that were
+ * overwritten before they could be read are counted as skipped.
+ *
+ * Usage: barShmReader [name], name defaults to /NDBar_13SIM1:Bar1:
+ *
+ * Created on: October 18, 2026
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NDBarSharedMemory.h"
+
+int main(int argc, char **argv) {
+    const char *name = argc > 1 ? argv[1] : "/NDBar_13SIM1:Bar1:";
+    NDBarShmRecord record;
+    uint64_t last = 0;
+    int i;
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror("shm_open");
+        return 1;
+    }
+    void *mapped = mmap(NULL, sizeof(NDBarShmRegion), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const NDBarShmRegion *region = (const NDBarShmRegion *) mapped;
+    if (!ndbar_shm_valid(region)) {
+        fprintf(stderr, "%s does not hold NDPluginBar results of this version\n", name);
+        return 1;
+    }
+
+    for (;;) {
+        uint64_t count = ndbar_shm_read_latest(region, &record);
+        if (count == last) {
+            // poll often enough to see each frame well within a millisecond
+            struct timespec pause = {0, 100000};
+            nanosleep(&pause, NULL);
+            continue;
+        }
+        if (last != 0 && count > last + 1)
+            printf("skipped %llu frames\n", (unsigned long long) (count - last - 1));
+        last = count;
+
+        printf("source %d frame %d: %d codes\n", record.source, record.unique_id,
+               record.num_codes);
+        for (i = 0; i < record.num_stored; i++) {
+            const NDBarShmCode *code = &record.codes[i];
+            printf("  %s \"%s\" row %d corners", code->type, code->data, code->manifest_row);
+            int j;
+            for (j = 0; j < code->num_corners && j < 4; j++)
+                printf(" (%d,%d)", code->corner_x[j], code->corner_y[j]);
+            printf("\n");
+        }
+        fflush(stdout);
+    }
+    return 0;
+}